@@ -0,0 +1,68 @@
+#ifndef ACCESS_PATTERN_H
+#define ACCESS_PATTERN_H
+
+#include <map>
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/DataTypes.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace MemoryAccessPass {
+
+	typedef enum {
+		// Same address every iteration of the innermost loop
+		AccessPattern_Invariant,
+		// Stride is the access size
+		AccessPattern_Sequential,
+		AccessPattern_Strided,
+		// Address depends on a value loaded in the loop: a gather
+		// (a[b[i]]) or a pointer chase (p = p->next)
+		AccessPattern_Indirect,
+		AccessPattern_Irregular
+	} AccessPatternType;
+
+	struct AccessPattern {
+		AccessPatternType type;
+		// In bytes, per iteration (Sequential, Strided)
+		int64_t stride;
+		// Indirect: The load in the loop the address depends on
+		llvm::LoadInst * source;
+		// Indirect: source's result comes back to the address through a
+		// phi of the loop header
+		bool isPointerChase;
+
+		AccessPattern() : type(AccessPattern_Irregular), stride(0), source(0),
+				isPointerChase(false) {}
+	};
+
+	// Classifies loads and stores in loops by how their address changes
+	// across iterations of the innermost loop. Accesses outside loops are
+	// not classified.
+	class AccessPatternAnalysis : public llvm::FunctionPass {
+	protected:
+		std::map<const llvm::Instruction *, AccessPattern> patterns;
+		llvm::Function * function;
+
+		llvm::LoadInst * findSource(llvm::Value * pointer, llvm::Loop * L,
+				bool & isPointerChase) const;
+		AccessPattern classify(llvm::Value * pointer, uint64_t size, llvm::Loop * L,
+				llvm::ScalarEvolution & SE) const;
+	public:
+		static char ID;
+		AccessPatternAnalysis() : llvm::FunctionPass(ID), function(0) {}
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+		virtual bool runOnFunction(llvm::Function &F);
+		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
+		// 0 if access is not a load or store in a loop
+		const AccessPattern * getPattern(const llvm::Instruction * access) const;
+		const std::map<const llvm::Instruction *, AccessPattern> & getPatterns() const {
+			return patterns;
+		}
+	};
+}
+#endif // ACCESS_PATTERN_H
@@ -0,0 +1,67 @@
+#ifndef ARENA_ALLOCATOR_H
+#define ARENA_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+#include <llvm/Support/AlignOf.h>
+#include <llvm/Support/Allocator.h>
+
+namespace MemoryAccessPass {
+
+	// STL allocator over a BumpPtrAllocator. Deallocation is a no-op; the
+	// memory is returned when the arena is reset or destroyed.
+	// Without an arena, falls back to the global heap.
+	template <class T>
+	class ArenaAllocator {
+	public:
+		typedef T value_type;
+		typedef T * pointer;
+		typedef const T * const_pointer;
+		typedef T & reference;
+		typedef const T & const_reference;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+		template <class U> struct rebind {
+			typedef ArenaAllocator<U> other;
+		};
+
+		llvm::BumpPtrAllocator * m_arena;
+
+		ArenaAllocator() : m_arena(0) {}
+		explicit ArenaAllocator(llvm::BumpPtrAllocator * arena) : m_arena(arena) {}
+		template <class U>
+		ArenaAllocator(const ArenaAllocator<U> & other) : m_arena(other.m_arena) {}
+
+		pointer address(reference x) const { return &x; }
+		const_pointer address(const_reference x) const { return &x; }
+		size_type max_size() const { return ((size_type)-1) / sizeof(T); }
+
+		pointer allocate(size_type n, const void * hint = 0) {
+			if (!m_arena) {
+				return static_cast<pointer>(::operator new(n * sizeof(T)));
+			}
+			return static_cast<pointer>(m_arena->Allocate(n * sizeof(T),
+					llvm::AlignOf<T>::Alignment));
+		}
+		void deallocate(pointer p, size_type n) {
+			if (!m_arena) {
+				::operator delete(p);
+			}
+		}
+		void construct(pointer p, const T & value) { new (p) T(value); }
+		void destroy(pointer p) { p->~T(); }
+	};
+
+	template <class T, class U>
+	bool operator==(const ArenaAllocator<T> & left, const ArenaAllocator<U> & right) {
+		return left.m_arena == right.m_arena;
+	}
+
+	template <class T, class U>
+	bool operator!=(const ArenaAllocator<T> & left, const ArenaAllocator<U> & right) {
+		return left.m_arena != right.m_arena;
+	}
+}
+
+#endif // ARENA_ALLOCATOR_H
@@ -0,0 +1,48 @@
+#ifndef CANONICAL_SUMMARY_H
+#define CANONICAL_SUMMARY_H
+
+#include <set>
+#include <vector>
+
+#include <llvm/IR/GlobalValue.h>
+
+namespace MemoryAccessPass {
+
+	class MemoryAccessInstVisitor;
+	class MemoryAccessData;
+
+	// The part of a function's summary its callers see, independent of
+	// the function's body: the globals written, the indices of arguments
+	// written through, and whether anything else may be written.
+	// Interned, so equal summaries are the same object.
+	struct CanonicalSummary {
+		// Sorted
+		std::vector<const llvm::GlobalValue *> globals;
+		std::vector<unsigned> arguments;
+		// Heap or unknown stores, or stores through pointers derived
+		// from arguments
+		bool isModifiesUnknown;
+		bool hasIndirectCalls;
+		bool isSummarise;
+		bool isOverBudget;
+
+		CanonicalSummary();
+		void build(const MemoryAccessInstVisitor & visitor);
+		// From data alone, for summaries still being computed. Not
+		// summarise.
+		void build(const MemoryAccessData & data);
+		bool operator<(const CanonicalSummary & other) const;
+	};
+
+	class SummaryInterner {
+	protected:
+		std::set<CanonicalSummary> m_summaries;
+	public:
+		// Returned summaries live as long as the interner
+		const CanonicalSummary * intern(const CanonicalSummary & summary);
+		unsigned size() const { return m_summaries.size(); }
+		void clear() { m_summaries.clear(); }
+	};
+}
+
+#endif // CANONICAL_SUMMARY_H
@@ -1,11 +1,14 @@
 #ifndef CHAOTIC_ITERATION_H
 #define CHAOTIC_ITERATION_H
 
-#include <list>
+#include <vector>
 
 #include <llvm/InstVisitor.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <CondensedCFG.h>
+#include <Dataflow.h>
+
 namespace MemoryAccessPass {
 
 	class Join {
@@ -13,54 +16,38 @@ namespace MemoryAccessPass {
 		bool join(const llvm::BasicBlock * from, const llvm::BasicBlock * to);
 	};
 
-	class BasicBlockInFunctionComparator {
+	// Edges of a CondensedCFG, for DataflowEngine
+	class CondensedEdges {
 	private:
-		llvm::Function & m_function;
+		const CondensedCFG * m_cfg;
 	public:
-		BasicBlockInFunctionComparator(llvm::Function & function): m_function(function) {}
-		bool operator()(llvm::BasicBlock * left, llvm::BasicBlock * right) const {
-			if (left == right) {
-				return false;
-			}
-			int left_idx = -1;
-			int right_idx = -1;
-			int idx = 0;
-			for (llvm::Function::const_iterator it = m_function.begin(),
-								ie = m_function.end();
-					it != ie; it++) {
-				if (left == it) {
-					left_idx = idx;
-				}
-				if (right == it) {
-					right_idx = idx;
-				}
-				idx++;
+		CondensedEdges(const CondensedCFG & cfg) : m_cfg(&cfg) {}
+		void getEntries(llvm::Function & F, std::vector<llvm::BasicBlock *> & entries) const {
+			if (!F.empty()) {
+				entries.push_back(&F.getEntryBlock());
 			}
-			return (left_idx < right_idx);
+		}
+		void getTargets(llvm::BasicBlock * BB, std::vector<llvm::BasicBlock *> & targets) const {
+			const std::vector<llvm::BasicBlock *> & successors = m_cfg->getSuccessors(BB);
+			targets.insert(targets.end(), successors.begin(), successors.end());
 		}
 	};
 
+	// Visits blocks in function layout order, until T's join reports no
+	// more changes. Runs on DataflowEngine.
 	template <class T> class ChaoticIteration {
 	private:
 		T & m_visitor;
+		const CondensedCFG * m_cfg;
 	protected:
-		void populateWorklistWithSuccessors(
-				std::list<llvm::BasicBlock *> & worklist,
-				const llvm::BasicBlock & element) {
-			const llvm::TerminatorInst * terminator = element.getTerminator();
-			int successorCount = terminator->getNumSuccessors();
-			T & visitor = getVisitor();
-			for (int idx = 0; idx < successorCount; idx++) {
-				llvm::BasicBlock * BB = terminator->getSuccessor(idx);
-				if (visitor.join(&element, BB)) {
-					worklist.push_back(BB);
-				}
-			}
-		}
 		T & getVisitor() { return m_visitor; }
 
 	public:
-		ChaoticIteration<T>(T & visitor) : m_visitor(visitor) {};
+		ChaoticIteration<T>(T & visitor) : m_visitor(visitor), m_cfg(0) {};
+		// Iterate over the condensed graph only. Blocks outside it are
+		// expected to be mapped to their representative by the visitor.
+		ChaoticIteration<T>(T & visitor, const CondensedCFG & cfg) :
+				m_visitor(visitor), m_cfg(&cfg) {};
 		void iterate(llvm::Function * F) { return iterate(*F); }
 		void iterate(llvm::Function & F) {
 			getVisitor().visitFunction(F);
@@ -71,18 +58,32 @@ namespace MemoryAccessPass {
 		}
 		void iterate(llvm::BasicBlock * BB) { return iterate(*BB); }
 		void iterate(llvm::BasicBlock & BB) {
-			BasicBlockInFunctionComparator comparator(*BB.getParent());
-			std::list<llvm::BasicBlock *> worklist;
-			worklist.push_back(&BB);
-			T & visitor = getVisitor();
-			while (!worklist.empty()) {
-				llvm::BasicBlock * element = worklist.front();
-				worklist.pop_front();
-				visitor.visit(element);
-				populateWorklistWithSuccessors(worklist, *element);
-				worklist.sort(comparator);
-				worklist.unique();
+			std::vector<llvm::BasicBlock *> entries(1, &BB);
+			if (m_cfg) {
+				llvm::DataflowEngine<T, CondensedEdges> engine(getVisitor(),
+						CondensedEdges(*m_cfg));
+				engine.run(*BB.getParent(), entries);
+				return;
+			}
+			llvm::DataflowEngine<T> engine(getVisitor());
+			engine.run(*BB.getParent(), entries);
+		}
+
+		// As iterate, on DeltaDataflowEngine. T provides its protocol.
+		void iterateDeltas(llvm::Function & F) {
+			getVisitor().visitFunction(F);
+			if (F.empty()) {
+				return;
+			}
+			std::vector<llvm::BasicBlock *> entries(1, &F.getEntryBlock());
+			if (m_cfg) {
+				llvm::DeltaDataflowEngine<T, CondensedEdges> engine(getVisitor(),
+						CondensedEdges(*m_cfg));
+				engine.run(F, entries);
+				return;
 			}
+			llvm::DeltaDataflowEngine<T> engine(getVisitor());
+			engine.run(F, entries);
 		}
 	};
 }
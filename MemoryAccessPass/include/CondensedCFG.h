@@ -0,0 +1,37 @@
+#ifndef CONDENSED_CFG_H
+#define CONDENSED_CFG_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+
+namespace MemoryAccessPass {
+
+	// A CFG reduced to the entry block, the given interesting blocks, and
+	// the merge points needed so that every other reachable block is
+	// reached from exactly one node (its representative). A block that
+	// is not a node has the same state as its representative.
+	class CondensedCFG {
+	protected:
+		std::set<const llvm::BasicBlock *> m_nodes;
+		std::map<const llvm::BasicBlock *, const llvm::BasicBlock *> m_representatives;
+		std::map<const llvm::BasicBlock *, std::vector<llvm::BasicBlock *> > m_successors;
+		std::vector<llvm::BasicBlock *> m_empty;
+	public:
+		void build(llvm::Function & F,
+				const std::set<const llvm::BasicBlock *> & interesting);
+		bool isNode(const llvm::BasicBlock * BB) const {
+			return m_nodes.count(BB);
+		}
+		// Returns 0 for unreachable blocks
+		const llvm::BasicBlock * getRepresentative(const llvm::BasicBlock * BB) const;
+		const std::vector<llvm::BasicBlock *> & getSuccessors(
+				const llvm::BasicBlock * BB) const;
+		unsigned size() const { return m_nodes.size(); }
+	};
+}
+
+#endif // CONDENSED_CFG_H
@@ -0,0 +1,47 @@
+#ifndef ESCAPE_ANALYSIS_H
+#define ESCAPE_ANALYSIS_H
+
+#include <map>
+#include <set>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+
+namespace MemoryAccessPass {
+
+	// The allocas a pointer may point into, or non-local if it may point
+	// anywhere else
+	struct PointerBase {
+		bool isNonLocal;
+		std::set<const llvm::AllocaInst *> allocas;
+
+		PointerBase() : isNonLocal(false) {}
+		bool join(const PointerBase & other);
+	};
+
+	// Intraprocedural. Finds the allocas whose address never leaves the
+	// function: It is not passed to calls, returned, converted to an
+	// integer, or stored anywhere but in other such allocas. Pointers
+	// derived from them, including through phis, selects and loads back
+	// from such allocas, are tracked.
+	// Optimistic: Starts with nothing escaping, and iterates to a fixpoint.
+	class AllocaEscapeAnalysis {
+	protected:
+		std::map<const llvm::Value *, PointerBase> m_bases;
+		std::set<const llvm::AllocaInst *> m_escaped;
+		// Pointers stored in each alloca
+		std::map<const llvm::AllocaInst *, PointerBase> m_contents;
+
+		PointerBase getBase(const llvm::Value * value) const;
+		PointerBase computeBase(const llvm::Instruction & I) const;
+		bool escape(const PointerBase & base);
+		bool addContents(const PointerBase & target, const PointerBase & base);
+		bool visitUses(const llvm::Instruction & I);
+	public:
+		void run(const llvm::Function & F);
+		// True if pointer only points into allocas that don't escape
+		bool isLocal(const llvm::Value * pointer) const;
+	};
+}
+
+#endif // ESCAPE_ANALYSIS_H
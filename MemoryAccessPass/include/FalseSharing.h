@@ -0,0 +1,73 @@
+#ifndef FALSE_SHARING_H
+#define FALSE_SHARING_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/DataTypes.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <MemoryAccess.h>
+
+namespace MemoryAccessPass {
+
+	extern int MemoryAccessRealignFalseSharing;
+
+	struct FalseSharingCandidate {
+		const llvm::GlobalVariable * first;
+		// 0: first alone is written from several threads
+		const llvm::GlobalVariable * second;
+		std::set<const llvm::Function *> roots;
+	};
+
+	// Finds globals written from more than one thread, and pairs of
+	// globals estimated to share a cache line that are written from
+	// different threads. Threads start at main and at the functions
+	// passed to pthread_create or thrd_create. Those may run in several
+	// threads at once. A root writes the globals in the summaries of the
+	// functions it reaches through direct calls. Indirect calls are not
+	// followed, so writes made only through them are missed.
+	// Layout is estimated: Globals are placed in module order within
+	// their section, at their alignment, from a line-aligned base.
+	// With MemoryAccessRealignFalseSharing, both globals of each pair are
+	// aligned to the cache line and padded to whole lines. Only globals
+	// with local linkage are changed, since other modules may rely on the
+	// type and size of the rest. Those are reported only.
+	class FalseSharing : public llvm::ModulePass {
+	protected:
+		struct Placement {
+			const llvm::GlobalVariable * global;
+			uint64_t offset;
+			uint64_t size;
+		};
+		std::vector<FalseSharingCandidate> candidates;
+		// Roots that may run in several threads at once
+		std::set<const llvm::Function *> threadRoots;
+		std::map<const llvm::GlobalVariable *, std::set<const llvm::Function *> > writers;
+		unsigned realignedCount;
+
+		void findRoots(llvm::Module & M, std::vector<llvm::Function *> & roots);
+		void addWrites(llvm::Function * root, MemoryAccess & memoryAccess);
+		bool isConcurrent(const std::set<const llvm::Function *> & a,
+				const std::set<const llvm::Function *> & b) const;
+		void place(llvm::Module & M, const llvm::DataLayout & DL,
+				std::map<std::string, std::vector<Placement> > & sections) const;
+		llvm::GlobalVariable * pad(llvm::GlobalVariable * global,
+				const llvm::DataLayout & DL, uint64_t lineBytes);
+	public:
+		static char ID;
+		FalseSharing() : llvm::ModulePass(ID), realignedCount(0) {}
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+		virtual bool runOnModule(llvm::Module &M);
+		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
+		const std::vector<FalseSharingCandidate> & getCandidates() const { return candidates; }
+	};
+}
+#endif // FALSE_SHARING_H
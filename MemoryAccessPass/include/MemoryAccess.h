@@ -1,25 +1,74 @@
 #ifndef MEMORY_ACCESS_H
 #define MEMORY_ACCESS_H
+#include <list>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/DataTypes.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <MemoryAccessInstVisitor.h>
 #include <MemoryAccessCache.h>
+#include <CanonicalSummary.h>
+#include <ModRefSummary.h>
+#include <SummarySpill.h>
+
+namespace llvm {
+	class IndirectCallIndex;
+}
 
 namespace MemoryAccessPass {
 
 	extern const char * predefinedFunctions[];
 	bool isPredefinedFunction(llvm::Function & F);
+	extern uint64_t MemoryAccessSummaryMemoryCap;
+	extern const char * MemoryAccessSpillPath;
+	extern int MemoryAccessIndirectCallFanout;
+	extern int MemoryAccessNarrowVirtualCalls;
 
 	class MemoryAccess : public llvm::FunctionPass {
 	protected:
 		MemoryAccessInstVisitor * lastVisitor;
 		std::map<llvm::Function *, MemoryAccessInstVisitor *> visitors;
+		// Visitors with a resident summary. Most recently used first.
+		std::list<MemoryAccessInstVisitor *> residentVisitors;
+		std::map<MemoryAccessInstVisitor *,
+				std::list<MemoryAccessInstVisitor *>::iterator> residentPositions;
+		// Visitors with a compacted summary. Most recently compacted first.
+		std::list<MemoryAccessInstVisitor *> flatVisitors;
+		std::map<MemoryAccessInstVisitor *,
+				std::list<MemoryAccessInstVisitor *>::iterator> flatPositions;
+		// Of both resident and compacted summaries
+		size_t residentBytes;
+		SummarySpillFile * spillFile;
+		// Set after a failed write. Compacted summaries then stay in memory.
+		bool isSpillFailed;
+		// Number of getModifiableVisitor calls computing a summary
+		int computeDepth;
+		// Functions released only by an explicit release()
+		std::set<llvm::Function *> pinnedFunctions;
+		// See setDropCalleeData
+		bool isDropCalleeData;
+		// Callee to the functions whose summaries joined it
+		std::map<llvm::Function *, std::set<llvm::Function *> > callers;
+		// The reverse of callers, to prune it
+		std::map<llvm::Function *, std::set<llvm::Function *> > callees;
+		SummaryInterner summaries;
+		ValueNumbering numbering;
+		// Built on first indirect call, for indexedModule
+		llvm::IndirectCallIndex * indirectCallIndex;
+		const llvm::Module * indexedModule;
 		MemoryAccessInstVisitor * getModifiableVisitor(llvm::Function *F);
+		void touch(MemoryAccessInstVisitor * visitor);
+		void compact(MemoryAccessInstVisitor * visitor);
+		bool spill(MemoryAccessInstVisitor * visitor);
+		void reload(MemoryAccessInstVisitor * visitor);
+		void forget(MemoryAccessInstVisitor * visitor);
 	public:
 		static char ID;
 		MemoryAccess();
@@ -28,14 +77,46 @@ namespace MemoryAccessPass {
 		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
 		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
 		void print(llvm::raw_ostream &O, const MemoryAccessData & data) const;
+		void print(llvm::raw_ostream &O, const MemoryAccessInstVisitor & visitor) const;
+		void printData(llvm::raw_ostream &O, const MemoryAccessData & data) const;
 		void print(llvm::raw_ostream &O, const StoreBaseToValueMap & stores) const;
 		void print(llvm::raw_ostream &O, const MemoryAccessData & data, const ValueSet & stores) const;
 		void printAA(llvm::raw_ostream &O) const;
 
 		bool isSummariseFunction() const;
 		const MemoryAccessData * getSummaryData() const;
+		// With MemoryAccessSummaryMemoryCap set, the returned visitor's
+		// functionData is only valid until the next call.
 		const MemoryAccessInstVisitor * getVisitor(llvm::Function *F);
+		// For drivers that print only the functions they pin: Functions
+		// first summarised for a caller then keep no stack stores or
+		// stored values, and lazily loaded ones are released. Off by
+		// default, so that a summary prints the same however it was
+		// first reached.
+		void setDropCalleeData(bool isDrop) { isDropCalleeData = isDrop; }
 		void clear();
+		// F was modified. Recompute its summary, and those of its callers
+		// as long as their canonical summaries change.
+		// Invalidates visitors and ModRefSummary references of the
+		// recomputed functions.
+		void invalidate(llvm::Function *F);
+		void addCaller(llvm::Function *callee, llvm::Function *caller);
+		// caller's summary is recomputed, and joins its callees again
+		void removeCaller(llvm::Function *caller);
+		bool getIndirectCallees(const llvm::CallInst & ci,
+				std::vector<llvm::Function *> & callees);
+		// Detach F's summary from its body and dematerialize F, if it
+		// was materialized lazily
+		void release(llvm::Function *F);
+		// Keep F's body until release(F) is called
+		void pin(llvm::Function *F);
+
+		const ModRefSummary & getModRefSummary(llvm::Function *F);
+		bool mayModify(llvm::CallInst & ci, llvm::Value * pointer);
+		void mayModify(llvm::CallInst & ci,
+				const std::vector<llvm::Value *> & pointers,
+				std::vector<bool> & result);
+		bool mayModifyGlobal(llvm::Function & F, llvm::GlobalValue * global);
 	};
 }
 #endif // MEMORY_ACCESS_H
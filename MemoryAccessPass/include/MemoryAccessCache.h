@@ -1,6 +1,8 @@
 #ifndef MEMORY_ACCESS_CACHE_H
 #define MEMORY_ACCESS_CACHE_H
 
+#include <vector>
+
 namespace MemoryAccessPass {
 
 class MemoryAccessInstVisitor;
@@ -8,6 +10,11 @@ class MemoryAccessInstVisitor;
 class MemoryAccessCache {
 public:
 	virtual const MemoryAccessInstVisitor * getVisitor(llvm::Function *F) = 0;
+	// caller's summary was computed using callee's
+	virtual void addCaller(llvm::Function *callee, llvm::Function *caller) = 0;
+	// Returns false if ci's callees are unknown
+	virtual bool getIndirectCallees(const llvm::CallInst & ci,
+			std::vector<llvm::Function *> & callees) = 0;
 };
 
 template <class T>
@@ -19,6 +26,13 @@ public:
 	virtual const MemoryAccessInstVisitor * getVisitor(llvm::Function *F) {
 		return m_duckImpl.getVisitor(F);
 	}
+	virtual void addCaller(llvm::Function *callee, llvm::Function *caller) {
+		m_duckImpl.addCaller(callee, caller);
+	}
+	virtual bool getIndirectCallees(const llvm::CallInst & ci,
+			std::vector<llvm::Function *> & callees) {
+		return m_duckImpl.getIndirectCallees(ci, callees);
+	}
 };
 
 }
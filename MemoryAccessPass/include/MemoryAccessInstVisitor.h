@@ -9,14 +9,26 @@
 #include <llvm/InstVisitor.h>
 #include <llvm/IR/Instructions.h>
 
+#include <ArenaAllocator.h>
+#include <CanonicalSummary.h>
+#include <EscapeAnalysis.h>
 #include <MemoryAccessCache.h>
+#include <ModRefSummary.h>
+#include <ValueNumbering.h>
 #include <ValueVisitor.h>
 
 namespace MemoryAccessPass {
+	struct FlatSummary;
+
 	extern int MemoryAccessGlobalAccessWatermark;
 	extern int MemoryAccessArgumentAccessWatermark;
 	extern int MemoryAccessFunctionCallCountWatermark;
 	extern int VisitBlockCountWatermark;
+	extern int MemoryAccessSparseIteration;
+	extern int MemoryAccessCondenseCFG;
+	extern int MemoryAccessDeltaJoin;
+	extern int MemoryAccessWideningThreshold;
+	extern int MemoryAccessEscapeAnalysis;
 
 	typedef enum {
 		StoredValueTypeUnknown = 0,
@@ -56,6 +68,7 @@ namespace MemoryAccessPass {
 			value = other.value;
 			type = other.type;
 		}
+		// By address. Containers order by ValueNumberLess.
 		bool operator<(const StoredValue & other) const {
 			return (value < other.value);
 		}
@@ -97,27 +110,33 @@ namespace MemoryAccessPass {
 	}
 
 	typedef std::vector<StoredValue> StoredValues;
-	typedef std::map<const llvm::Value*, StoredValue> StoreBaseToValueMap;
-	typedef std::set<const llvm::Value*> ValueSet;
+	typedef Numbered<llvm::Value> ValueKey;
+	typedef Numbered<llvm::CallInst> CallInstKey;
+	typedef std::map<ValueKey, StoredValue,
+			ValueNumberLess,
+			ArenaAllocator<std::pair<const ValueKey, StoredValue> > >
+					StoreBaseToValueMap;
+	typedef std::set<ValueKey,
+			ValueNumberLess,
+			ArenaAllocator<ValueKey> > ValueSet;
+	typedef std::set<CallInstKey,
+			ValueNumberLess,
+			ArenaAllocator<CallInstKey> > CallInstSet;
+
+	// The cache doubles as the block's temporaries, which are joined
+	// between blocks: It stays an ordered map.
+	typedef llvm::MapValueCache<StoreBaseToValueMap> EvaluatorCache;
 
-	class Evaluator : public llvm::ValueVisitor<Evaluator, StoredValue> {
+	class Evaluator : public llvm::ValueVisitor<Evaluator, StoredValue, EvaluatorCache> {
 	private:
 		StoreBaseToValueMap & m_stores;
-		std::vector<llvm::Instruction *> m_instsToDestroy;
 	public:
-		Evaluator(StoreBaseToValueMap & stores) : ValueVisitor<Evaluator, StoredValue>(), m_stores(stores) {}
+		Evaluator(StoreBaseToValueMap & stores) :
+				ValueVisitor<Evaluator, StoredValue, EvaluatorCache>(),
+				m_stores(stores) {}
 		Evaluator(StoreBaseToValueMap & stores, StoreBaseToValueMap & cache) :
-				ValueVisitor<Evaluator, StoredValue>(cache), m_stores(stores) {}
-		~Evaluator() {
-			for (std::vector<llvm::Instruction *>::iterator it = m_instsToDestroy.begin(),
-									ie = m_instsToDestroy.end();
-					it != ie; it++) {
-				llvm::Instruction * inst = *it;
-				delete inst;
-				*it = 0;
-			}
-		}
-
+				ValueVisitor<Evaluator, StoredValue, EvaluatorCache>(EvaluatorCache(cache)),
+				m_stores(stores) {}
 		StoredValue visitInstruction(llvm::Instruction & instruction) {
 			//llvm::errs() << __PRETTY_FUNCTION__ << ": " << instruction << ": Return top\n";
 			StoredValue result(&instruction, StoredValueTypeUnknown);
@@ -164,27 +183,77 @@ namespace MemoryAccessPass {
 		ValueSet unknownStores;
 		StoreBaseToValueMap temporaries;
 		StoreBaseToValueMap stores;
-		std::set<const llvm::CallInst *> functionCalls;
-		std::set<const llvm::CallInst *> indirectFunctionCalls;
+		CallInstSet functionCalls;
+		CallInstSet indirectFunctionCalls;
+		// Keys of stores, in the order they changed (delta joins)
+		std::vector<const llvm::Value*, ArenaAllocator<const llvm::Value*> > storesLog;
+		// Number of times each key of stores changed (widening)
+		std::map<const llvm::Value*, unsigned, std::less<const llvm::Value*>,
+				ArenaAllocator<std::pair<const llvm::Value* const, unsigned> > >
+						storesChangeCount;
 		//MemoryAccessData(MemoryAccessData& ); // TODO Copy constructor
 
-		MemoryAccessData();
+		// All containers allocate from arena. With no arena, from the heap.
+		// Containers order values by numbering, or by address without one.
+		MemoryAccessData(llvm::BumpPtrAllocator * arena = 0,
+				ValueNumbering * numbering = 0);
 		~MemoryAccessData();
 	};
 
 	// Per function. For now.
 	class MemoryAccessInstVisitor : public llvm::InstVisitor<MemoryAccessInstVisitor> {
 	public:
+		// Keys of stores that changed (DeltaDataflowEngine)
+		typedef std::set<const llvm::Value*> DeltaType;
+
 		int visitBlockCount;
 		bool haveIHadEnough;
+		// Backs data, and everything in it
+		llvm::BumpPtrAllocator arena;
 		std::map<const llvm::BasicBlock*, MemoryAccessData*> data;
+		// Blocks sharing the state of another block (sparse iteration)
+		std::map<const llvm::BasicBlock*, const llvm::BasicBlock*> dataOwners;
 		llvm::Function * function;
 		MemoryAccessData * functionData;
+		// Per edge (source data, target data): Positions in the source's
+		// and in the target's storesLog up to which they were joined over
+		// that edge. The target's own changes are joined over again, as
+		// the dense join would.
+		std::map<std::pair<const MemoryAccessData*, const MemoryAccessData*>,
+				std::pair<size_t, size_t> > edgeCursors;
 		mutable Tristate isSummariseFunctionCache;
-		MemoryAccessInstVisitor();
+		ModRefSummary * modRefSummary;
+		// Interned. Set by the cache once the summary is computed.
+		const CanonicalSummary * canonicalSummary;
+		// Candidate callees of the resolved indirect calls, which are no
+		// longer in functionData. Sorted.
+		std::vector<llvm::Function *> indirectCallees;
+		ValueNumbering * numbering;
+		// Only while iterating
+		AllocaEscapeAnalysis * escapeAnalysis;
+		// functionData of an evicted summary, compacted but still in
+		// memory. 0 if not compacted, or spilled since.
+		FlatSummary * flatData;
+		// Offset of functionData in the spill file, or -1 if not spilled
+		long spillOffset;
+		MemoryAccessInstVisitor(ValueNumbering * numbering = 0);
 		~MemoryAccessInstVisitor();
 		MemoryAccessData & getData(const llvm::BasicBlock * bb);
+		void releaseBlockData();
+		void compactSummary();
+		void detachFromBody(llvm::Function & F);
+		// Stands for what F writes that has no value outside its body.
+		// Prints as F's name, not its body.
+		static const llvm::Value * getSummaryHandle(const llvm::Function & F);
+		void dropCallerInvisibleData();
+		bool isEvicted() const {
+			return (!functionData) && (flatData || (spillOffset >= 0));
+		}
+		void setDataOwner(const llvm::BasicBlock * bb, const llvm::BasicBlock * owner);
+		bool hasMemoryEffects(const llvm::BasicBlock & bb) const;
 		void runOnFunction(llvm::Function &, MemoryAccessCache * cache = 0);
+		using llvm::InstVisitor<MemoryAccessInstVisitor>::visit;
+		void visit(llvm::BasicBlock * bb, DeltaType & changed);
 		bool isSummariseFunction() const;
 		void visitFunction(llvm::Function &);
 		void visitBasicBlock(llvm::BasicBlock &);
@@ -193,17 +262,30 @@ namespace MemoryAccessPass {
 		void store(MemoryAccessData & data, StoredValue & pointer, StoredValue & value);
 		void join(MemoryAccessCache * cache = 0);
 		bool join(const llvm::BasicBlock * from, const llvm::BasicBlock * to);
-		bool join(const MemoryAccessData & from, MemoryAccessData & to) const;
+		bool join(const llvm::BasicBlock * from, const llvm::BasicBlock * to,
+				const DeltaType & changed, DeltaType & toChanged);
+		bool join(const MemoryAccessData & from, MemoryAccessData & to,
+				bool isJoinStores = true) const;
 		bool join(const StoreBaseToValueMap & from,
 				StoreBaseToValueMap & to) const;
-		template <class T>
-		bool join(const std::set<const T *> & from,
-				std::set<const T *> & to) const;
+		template <class SetType>
+		bool join(const SetType & from, SetType & to) const;
 		bool joinCall(const llvm::CallInst & ci, MemoryAccessCache * cache);
+		bool joinCall(const llvm::CallInst & ci, llvm::Function * F,
+				MemoryAccessCache * cache);
 		bool joinCalleeArguments(const llvm::CallInst & ci,
-				const MemoryAccessInstVisitor * visitor);
+				const CanonicalSummary & summary);
 		bool joinStoredValues(StoreBaseToValueMap & stores,
 				const llvm::Value * pointer, const StoredValue &value) const;
+		bool joinStores(const MemoryAccessData & from, MemoryAccessData & to) const;
+		bool joinStores(const MemoryAccessData & from, MemoryAccessData & to,
+				const DeltaType & keys) const;
+		bool joinStoredValue(MemoryAccessData & data,
+				const llvm::Value * pointer, const StoredValue &value) const;
+		void storeChanged(MemoryAccessData & data,
+				const llvm::Value * pointer) const;
+		bool isWidened(const MemoryAccessData & data,
+				const llvm::Value * pointer) const;
 	};
 }
 #endif // MEMORY_ACCESS_INST_VISITOR_H
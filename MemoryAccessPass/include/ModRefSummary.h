@@ -0,0 +1,51 @@
+#ifndef MOD_REF_SUMMARY_H
+#define MOD_REF_SUMMARY_H
+
+#include <vector>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/Support/DataTypes.h>
+
+namespace MemoryAccessPass {
+
+	class MemoryAccessData;
+
+	// Fixed size Bloom filter over pointers. May answer true for pointers
+	// never inserted, never answers false for an inserted pointer.
+	class PointerBloomFilter {
+	public:
+		static const unsigned Bits = 256;
+	protected:
+		uint64_t m_words[Bits / 64];
+		static void hash(const void * pointer, unsigned & h1, unsigned & h2);
+	public:
+		PointerBloomFilter();
+		void insert(const void * pointer);
+		bool mayContain(const void * pointer) const;
+	};
+
+	// Compact mod information of a function, derived from its summary.
+	// Stored pointers are reduced to their underlying objects: the
+	// globals written, and the indices of arguments written through.
+	class ModRefSummary {
+	protected:
+		bool m_isModifiesAnything;
+		PointerBloomFilter m_globalsFilter;
+		// Exact fallback for the filter. Sorted.
+		std::vector<const llvm::Value *> m_globals;
+		std::vector<unsigned> m_arguments;
+	public:
+		ModRefSummary();
+		void build(const MemoryAccessData & data);
+		void setModifiesAnything() { m_isModifiesAnything = true; }
+		bool isModifiesAnything() const { return m_isModifiesAnything; }
+		bool isModifiesGlobals() const { return !m_globals.empty(); }
+		bool mayModifyGlobal(const llvm::GlobalValue * global) const;
+		const std::vector<unsigned> & getModifiedArguments() const {
+			return m_arguments;
+		}
+	};
+}
+
+#endif // MOD_REF_SUMMARY_H
@@ -0,0 +1,54 @@
+#ifndef PREFETCH_INSERTION_H
+#define PREFETCH_INSERTION_H
+
+#include <map>
+#include <set>
+
+#include <llvm/Analysis/Dominators.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpander.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Pass.h>
+
+#include <AccessPattern.h>
+
+namespace MemoryAccessPass {
+
+	extern int MemoryAccessPrefetchDistance;
+	extern int MemoryAccessPrefetchMinStride;
+
+	// Inserts llvm.prefetch for loop accesses AccessPatternAnalysis finds:
+	//	Strided, at least MemoryAccessPrefetchMinStride bytes: The address
+	//	MemoryAccessPrefetchDistance iterations ahead.
+	//	Gathers (a[b[i]]) with a counted loop that loads b[i] on every
+	//	iteration: b[i + distance] is loaded, clamped to the last
+	//	iteration, and a[b[i + distance]] prefetched.
+	//	Pointer chases: The next node, as soon as its address is loaded.
+	// Opt in: Only runs when requested.
+	class PrefetchInsertion : public llvm::FunctionPass {
+	protected:
+		llvm::Function * prefetch;
+		unsigned insertedCount;
+
+		void emitPrefetch(llvm::IRBuilder<> & builder, llvm::Value * address,
+				bool isWrite);
+		bool insertStrided(llvm::Instruction * access, llvm::Value * pointer,
+				llvm::ScalarEvolution & SE, llvm::SCEVExpander & expander);
+		bool insertGather(llvm::Instruction * access, llvm::Value * pointer,
+				const AccessPattern & pattern, llvm::Loop * L,
+				llvm::ScalarEvolution & SE, llvm::DominatorTree & DT,
+				llvm::SCEVExpander & expander);
+		bool insertChase(llvm::LoadInst * source, llvm::Loop * L,
+				std::set<llvm::LoadInst *> & chased);
+	public:
+		static char ID;
+		PrefetchInsertion() : llvm::FunctionPass(ID), prefetch(0), insertedCount(0) {}
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+		virtual bool runOnFunction(llvm::Function &F);
+		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
+	};
+}
+#endif // PREFETCH_INSERTION_H
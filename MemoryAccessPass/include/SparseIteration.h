@@ -0,0 +1,126 @@
+#ifndef SPARSE_ITERATION_H
+#define SPARSE_ITERATION_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <llvm/InstVisitor.h>
+#include <llvm/Support/CFG.h>
+
+#include <ChaoticIteration.h>
+#include <Dataflow.h>
+
+namespace MemoryAccessPass {
+
+	// Sparse alternative to ChaoticIteration.
+	// Only blocks with memory effects, the entry block, and merge points
+	// whose incoming states come from different owners get a state of
+	// their own. Every other block shares the state of the single block
+	// that reaches it (its owner), much like memory-SSA def-use chains.
+	// T must additionally provide:
+	// 	bool hasMemoryEffects(const llvm::BasicBlock &);
+	// 	void setDataOwner(const llvm::BasicBlock * bb,
+	// 			const llvm::BasicBlock * owner);
+	// Runs on DataflowEngine, in function layout order.
+	template <class T> class SparseIteration {
+	private:
+		T & m_visitor;
+		const llvm::BasicBlock * m_entry;
+		// Result of the last update: Successors need re-evaluation
+		bool m_isUpdated;
+		std::map<const llvm::BasicBlock *, const llvm::BasicBlock *> m_owners;
+		// Per owning block: Bumped whenever its state is re-computed
+		std::map<const llvm::BasicBlock *, unsigned> m_versions;
+		// Per sharing block: Owner version last propagated
+		std::map<const llvm::BasicBlock *, unsigned> m_seenVersions;
+		std::set<const llvm::BasicBlock *> m_visited;
+	protected:
+		T & getVisitor() { return m_visitor; }
+
+		const llvm::BasicBlock * getOwner(const llvm::BasicBlock * BB) const {
+			typename std::map<const llvm::BasicBlock *,
+					const llvm::BasicBlock *>::const_iterator it =
+							m_owners.find(BB);
+			if (it == m_owners.end()) {
+				return 0;
+			}
+			return it->second;
+		}
+
+		// Returns true if BB's successors need to be re-evaluated
+		bool update(llvm::BasicBlock & BB, bool isEntry) {
+			T & visitor = getVisitor();
+			std::set<const llvm::BasicBlock *> incomingOwners;
+			for (llvm::pred_iterator it = llvm::pred_begin(&BB),
+						ie = llvm::pred_end(&BB);
+					it != ie; it++) {
+				const llvm::BasicBlock * owner = getOwner(*it);
+				if (owner) {
+					incomingOwners.insert(owner);
+				}
+			}
+			const llvm::BasicBlock * currentOwner = getOwner(&BB);
+			bool isMaterialise = isEntry || (currentOwner == &BB) ||
+					(incomingOwners.size() > 1) ||
+					visitor.hasMemoryEffects(BB);
+			if (!isMaterialise) {
+				if (incomingOwners.empty()) {
+					return false;
+				}
+				const llvm::BasicBlock * owner = *incomingOwners.begin();
+				unsigned version = m_versions[owner];
+				if ((currentOwner == owner) &&
+						(m_seenVersions[&BB] == version)) {
+					return false;
+				}
+				m_owners[&BB] = owner;
+				m_seenVersions[&BB] = version;
+				visitor.setDataOwner(&BB, owner);
+				return true;
+			}
+			bool isChanged = (currentOwner != &BB);
+			m_owners[&BB] = &BB;
+			visitor.setDataOwner(&BB, &BB);
+			for (llvm::pred_iterator it = llvm::pred_begin(&BB),
+						ie = llvm::pred_end(&BB);
+					it != ie; it++) {
+				if (getOwner(*it)) {
+					isChanged |= visitor.join(*it, &BB);
+				}
+			}
+			if (!isChanged && m_visited.count(&BB)) {
+				return false;
+			}
+			m_visited.insert(&BB);
+			visitor.visit(BB);
+			m_versions[&BB]++;
+			return true;
+		}
+
+	public:
+		SparseIteration<T>(T & visitor) : m_visitor(visitor), m_entry(0), m_isUpdated(false) {};
+		void iterate(llvm::Function * F) { return iterate(*F); }
+		void iterate(llvm::Function & F) {
+			getVisitor().visitFunction(F);
+			if (F.empty()) {
+				return;
+			}
+			m_entry = &F.getEntryBlock();
+			std::vector<llvm::BasicBlock *> entries(1, &F.getEntryBlock());
+			llvm::DataflowEngine<SparseIteration<T> > engine(*this);
+			engine.run(F, entries);
+		}
+
+		// DataflowEngine visitor. Successors are pushed as a whole when BB
+		// was updated; T's join is called by update.
+		void visitFunction(llvm::Function & F) {}
+		void visit(llvm::BasicBlock * BB) {
+			m_isUpdated = update(*BB, BB == m_entry);
+		}
+		bool join(const llvm::BasicBlock * from, const llvm::BasicBlock * to) {
+			return m_isUpdated;
+		}
+	};
+}
+#endif // SPARSE_ITERATION_H
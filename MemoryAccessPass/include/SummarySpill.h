@@ -0,0 +1,56 @@
+#ifndef SUMMARY_SPILL_H
+#define SUMMARY_SPILL_H
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include <MemoryAccessInstVisitor.h>
+
+namespace MemoryAccessPass {
+
+	// Approximate heap footprint of a summary
+	size_t estimateMemoryUsage(const MemoryAccessData & data);
+
+	// A MemoryAccessData without the trees: sorted vectors only.
+	// Values are kept as raw pointers. A flat summary is only meaningful
+	// within the process, and while the module is alive.
+	struct FlatSummary {
+		typedef std::pair<const llvm::Value*, StoredValue> Entry;
+		enum {
+			StackStores = 0,
+			GlobalStores,
+			ArgumentStores,
+			HeapStores,
+			UnknownStores,
+			SetCount
+		};
+		std::vector<const llvm::Value*> sets[SetCount];
+		std::vector<Entry> temporaries;
+		std::vector<Entry> stores;
+		std::vector<const llvm::CallInst*> functionCalls;
+		std::vector<const llvm::CallInst*> indirectFunctionCalls;
+
+		void flatten(const MemoryAccessData & data);
+		void inflate(MemoryAccessData & data) const;
+		bool write(FILE * file) const;
+		bool read(FILE * file);
+	};
+
+	size_t estimateMemoryUsage(const FlatSummary & summary);
+
+	// Append-only file of flat summaries
+	class SummarySpillFile {
+	protected:
+		FILE * m_file;
+	public:
+		// With no path, an anonymous temporary file is used
+		SummarySpillFile(const char * path = 0);
+		~SummarySpillFile();
+		// Returns the offset of the record, or -1 on failure
+		long write(const FlatSummary & summary);
+		bool read(long offset, FlatSummary & summary);
+	};
+}
+
+#endif // SUMMARY_SPILL_H
@@ -0,0 +1,89 @@
+#ifndef VALUE_NUMBERING_H
+#define VALUE_NUMBERING_H
+
+#include <map>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Value.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/DataTypes.h>
+
+namespace MemoryAccessPass {
+
+	// Numbers that do not depend on where values are allocated.
+	// Globals are numbered in module order, in the high 32 bits. A
+	// function's arguments and instructions share its high bits, and are
+	// numbered in order in the low bits, all at once. Anything else
+	// (constants) is numbered below all globals, in order of first use.
+	class ValueNumbering {
+	protected:
+		llvm::DenseMap<const llvm::Value *, uint64_t> m_numbers;
+		// Numbered arguments and instructions, per function
+		std::map<const llvm::Function *, std::vector<const llvm::Value *> > m_locals;
+		uint64_t m_nextOther;
+		void numberModule(const llvm::Module & M);
+	public:
+		ValueNumbering();
+		// Before F is iterated, so that no key is numbered mid-iteration
+		void numberFunction(const llvm::Function & F);
+		uint64_t getNumber(const llvm::Value * V);
+		// F's body changed, or was dropped
+		void forget(const llvm::Function * F);
+		void clear();
+	};
+
+	// Container key. The number is looked up once, on the first
+	// comparison, and kept with the key; comparing keys that already
+	// have theirs costs no lookup. Converts back to the pointer.
+	template <class T>
+	struct Numbered {
+		const T * value;
+		// 0 until looked up
+		mutable uint64_t number;
+
+		Numbered(const T * a_value = 0) : value(a_value), number(0) {}
+		operator const T *() const { return value; }
+		const T * operator->() const { return value; }
+	};
+
+	// Orders values by number. Without a numbering, by address.
+	struct ValueNumberLess {
+		ValueNumbering * numbering;
+
+		ValueNumberLess(ValueNumbering * a_numbering = 0) :
+				numbering(a_numbering) {}
+		template <class T>
+		uint64_t getNumber(const Numbered<T> & key) const {
+			if (!key.number) {
+				key.number = numbering->getNumber(key.value);
+			}
+			return key.number;
+		}
+		template <class T>
+		bool operator()(const Numbered<T> & left, const Numbered<T> & right) const {
+			if (!numbering) {
+				return left.value < right.value;
+			}
+			if (left.value == right.value) {
+				return false;
+			}
+			return getNumber(left) < getNumber(right);
+		}
+	};
+}
+
+namespace llvm {
+	// isa, cast and dyn_cast see through keys
+	template <class T>
+	struct simplify_type<MemoryAccessPass::Numbered<T> > {
+		typedef const T * SimpleType;
+		static SimpleType getSimplifiedValue(MemoryAccessPass::Numbered<T> & key) {
+			return key.value;
+		}
+	};
+}
+
+#endif // VALUE_NUMBERING_H
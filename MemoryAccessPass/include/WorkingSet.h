@@ -0,0 +1,75 @@
+#ifndef WORKING_SET_H
+#define WORKING_SET_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/DataTypes.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <MemoryAccessInstVisitor.h>
+
+namespace MemoryAccessPass {
+
+	extern int MemoryAccessCacheLineBytes;
+	extern int MemoryAccessL1Bytes;
+	extern int MemoryAccessL2Bytes;
+	extern int MemoryAccessLLCBytes;
+	extern int MemoryAccessDefaultTripCount;
+
+	struct Footprint {
+		uint64_t bytes;
+		uint64_t lines;
+
+		Footprint() : bytes(0), lines(0) {}
+		void add(const Footprint & other);
+	};
+
+	struct FunctionWorkingSet {
+		std::string name;
+		Footprint total;
+		// Bytes per StoredValueType of the accessed pointer
+		uint64_t regionBytes[StoredValueTypeArgument + 1];
+		// Per outermost loop, named after its header
+		std::vector<std::pair<std::string, Footprint> > loopNests;
+
+		FunctionWorkingSet() {
+			for (int idx = 0; idx <= StoredValueTypeArgument; idx++) {
+				regionBytes[idx] = 0;
+			}
+		}
+	};
+
+	// Estimates the bytes and cache lines a function touches per
+	// invocation. Each load and store is expanded over its loop nest with
+	// the strides and trip counts ScalarEvolution finds. Unknown trip
+	// counts are taken as MemoryAccessDefaultTripCount. Accesses with an
+	// unknown stride touch a new line every iteration. Accesses through
+	// the same pointer in the same loop are counted once. Calls are not
+	// followed.
+	class WorkingSet : public llvm::ModulePass {
+	protected:
+		std::vector<FunctionWorkingSet> workingSets;
+
+		uint64_t getTripCount(llvm::Loop * L, llvm::ScalarEvolution & SE) const;
+		Footprint estimate(llvm::Value * pointer, uint64_t size, llvm::Loop * L,
+				llvm::ScalarEvolution & SE) const;
+		void runOnFunction(llvm::Function & F, FunctionWorkingSet & workingSet);
+	public:
+		static char ID;
+		WorkingSet() : llvm::ModulePass(ID) {}
+		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+		virtual bool runOnModule(llvm::Module &M);
+		// Functions over the L1 size, largest first
+		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
+		const std::vector<FunctionWorkingSet> & getWorkingSets() const { return workingSets; }
+	};
+}
+#endif // WORKING_SET_H
@@ -0,0 +1,145 @@
+#include <set>
+
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+
+#include <AccessPattern.h>
+
+namespace MemoryAccessPass {
+
+static const char * patternNames[] = {
+	"invariant", "sequential", "strided", "indirect", "irregular"
+};
+
+// The first load in L the address is computed from, through GEPs, casts,
+// arithmetic and phis. Breadth first, so a[b[c[i]]] finds the load of b.
+llvm::LoadInst * AccessPatternAnalysis::findSource(llvm::Value * pointer,
+		llvm::Loop * L, bool & isPointerChase) const {
+	std::vector<std::pair<llvm::Value *, bool> > worklist;
+	std::set<llvm::Value *> visited;
+	worklist.push_back(std::make_pair(pointer, false));
+	for (unsigned idx = 0; idx < worklist.size(); idx++) {
+		llvm::Instruction * I = llvm::dyn_cast<llvm::Instruction>(worklist[idx].first);
+		bool isThroughPhi = worklist[idx].second;
+		if (!I || !L->contains(I) || !visited.insert(I).second) {
+			continue;
+		}
+		if (llvm::LoadInst * li = llvm::dyn_cast<llvm::LoadInst>(I)) {
+			isPointerChase = isThroughPhi;
+			return li;
+		}
+		bool isPhi = llvm::isa<llvm::PHINode>(I);
+		if (!isPhi && !llvm::isa<llvm::GetElementPtrInst>(I) &&
+				!llvm::isa<llvm::CastInst>(I) && !llvm::isa<llvm::BinaryOperator>(I)) {
+			continue;
+		}
+		for (unsigned op = 0; op < I->getNumOperands(); op++) {
+			worklist.push_back(std::make_pair(I->getOperand(op), isThroughPhi || isPhi));
+		}
+	}
+	return 0;
+}
+
+AccessPattern AccessPatternAnalysis::classify(llvm::Value * pointer, uint64_t size,
+		llvm::Loop * L, llvm::ScalarEvolution & SE) const {
+	AccessPattern result;
+	const llvm::SCEV * scev = SE.getSCEV(pointer);
+	if (SE.isLoopInvariant(scev, L)) {
+		result.type = AccessPattern_Invariant;
+		return result;
+	}
+	const llvm::SCEVAddRecExpr * addRec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(scev);
+	if (addRec && (addRec->getLoop() == L)) {
+		const llvm::SCEVConstant * step = llvm::dyn_cast<llvm::SCEVConstant>(
+				addRec->getStepRecurrence(SE));
+		if (step) {
+			result.stride = step->getValue()->getSExtValue();
+			uint64_t distance = (result.stride < 0) ? -result.stride : result.stride;
+			result.type = (distance == size) ?
+					AccessPattern_Sequential : AccessPattern_Strided;
+			return result;
+		}
+	}
+	result.source = findSource(pointer, L, result.isPointerChase);
+	if (result.source) {
+		result.type = AccessPattern_Indirect;
+	}
+	return result;
+}
+
+bool AccessPatternAnalysis::runOnFunction(llvm::Function &F) {
+	patterns.clear();
+	function = &F;
+	llvm::LoopInfo & LI = getAnalysis<llvm::LoopInfo>();
+	llvm::ScalarEvolution & SE = getAnalysis<llvm::ScalarEvolution>();
+	llvm::DataLayout & DL = getAnalysis<llvm::DataLayout>();
+	for (llvm::Function::iterator bit = F.begin(), bie = F.end();
+			bit != bie; bit++) {
+		llvm::Loop * L = LI.getLoopFor(&*bit);
+		if (!L) {
+			continue;
+		}
+		for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+				it != ie; it++) {
+			llvm::Value * pointer = 0;
+			llvm::Type * type = 0;
+			if (llvm::LoadInst * li = llvm::dyn_cast<llvm::LoadInst>(&*it)) {
+				pointer = li->getPointerOperand();
+				type = li->getType();
+			} else if (llvm::StoreInst * si = llvm::dyn_cast<llvm::StoreInst>(&*it)) {
+				pointer = si->getPointerOperand();
+				type = si->getValueOperand()->getType();
+			} else {
+				continue;
+			}
+			patterns[&*it] = classify(pointer, DL.getTypeStoreSize(type), L, SE);
+		}
+	}
+	return false;
+}
+
+const AccessPattern * AccessPatternAnalysis::getPattern(
+		const llvm::Instruction * access) const {
+	std::map<const llvm::Instruction *, AccessPattern>::const_iterator it =
+			patterns.find(access);
+	return (it == patterns.end()) ? 0 : &it->second;
+}
+
+void AccessPatternAnalysis::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+	AU.setPreservesAll();
+	AU.addRequired<llvm::DataLayout>();
+	AU.addRequired<llvm::LoopInfo>();
+	AU.addRequired<llvm::ScalarEvolution>();
+}
+
+void AccessPatternAnalysis::print(llvm::raw_ostream &O, const llvm::Module *M) const {
+	if (!function) {
+		return;
+	}
+	O << "Access patterns in " << function->getName() << ":\n";
+	for (llvm::Function::const_iterator bit = function->begin(), bie = function->end();
+			bit != bie; bit++) {
+		for (llvm::BasicBlock::const_iterator it = bit->begin(), ie = bit->end();
+				it != ie; it++) {
+			const AccessPattern * pattern = getPattern(&*it);
+			if (!pattern) {
+				continue;
+			}
+			O << "\t" << patternNames[pattern->type];
+			if ((pattern->type == AccessPattern_Sequential) ||
+					(pattern->type == AccessPattern_Strided)) {
+				O << " " << pattern->stride;
+			}
+			if (pattern->isPointerChase) {
+				O << " (pointer chase)";
+			}
+			O << ":" << *it << "\n";
+		}
+	}
+}
+
+char AccessPatternAnalysis::ID = 0;
+static llvm::RegisterPass<AccessPatternAnalysis> _X(
+		"memaccesspattern",
+		"Classify loop memory accesses by pattern",
+		false, true);
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Argument.h>
+
+#include <CanonicalSummary.h>
+#include <MemoryAccessInstVisitor.h>
+
+namespace MemoryAccessPass {
+
+CanonicalSummary::CanonicalSummary() : isModifiesUnknown(false),
+		hasIndirectCalls(false), isSummarise(false), isOverBudget(false) {}
+
+void CanonicalSummary::build(const MemoryAccessInstVisitor & visitor) {
+	build(*visitor.functionData);
+	isSummarise = visitor.isSummariseFunction();
+	isOverBudget = visitor.haveIHadEnough;
+}
+
+void CanonicalSummary::build(const MemoryAccessData & data) {
+	isModifiesUnknown = !data.heapStores.empty() || !data.unknownStores.empty();
+	hasIndirectCalls = !data.indirectFunctionCalls.empty();
+	isSummarise = false;
+	isOverBudget = false;
+	globals.clear();
+	for (ValueSet::const_iterator it = data.globalStores.begin(),
+					ie = data.globalStores.end();
+			it != ie; it++) {
+		llvm::Value * object = llvm::GetUnderlyingObject(
+				const_cast<llvm::Value *>(it->value));
+		const llvm::GlobalValue * global = llvm::dyn_cast<llvm::GlobalValue>(object);
+		if (!global) {
+			isModifiesUnknown = true;
+			continue;
+		}
+		globals.push_back(global);
+	}
+	std::sort(globals.begin(), globals.end());
+	globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+	arguments.clear();
+	for (ValueSet::const_iterator it = data.argumentStores.begin(),
+					ie = data.argumentStores.end();
+			it != ie; it++) {
+		const llvm::Argument * argument = llvm::dyn_cast<llvm::Argument>(*it);
+		if (!argument) {
+			isModifiesUnknown = true;
+			continue;
+		}
+		arguments.push_back(argument->getArgNo());
+	}
+	std::sort(arguments.begin(), arguments.end());
+	arguments.erase(std::unique(arguments.begin(), arguments.end()),
+			arguments.end());
+}
+
+bool CanonicalSummary::operator<(const CanonicalSummary & other) const {
+	if (isModifiesUnknown != other.isModifiesUnknown) {
+		return isModifiesUnknown < other.isModifiesUnknown;
+	}
+	if (hasIndirectCalls != other.hasIndirectCalls) {
+		return hasIndirectCalls < other.hasIndirectCalls;
+	}
+	if (isSummarise != other.isSummarise) {
+		return isSummarise < other.isSummarise;
+	}
+	if (isOverBudget != other.isOverBudget) {
+		return isOverBudget < other.isOverBudget;
+	}
+	if (arguments != other.arguments) {
+		return arguments < other.arguments;
+	}
+	return globals < other.globals;
+}
+
+const CanonicalSummary * SummaryInterner::intern(const CanonicalSummary & summary) {
+	return &*m_summaries.insert(summary).first;
+}
+
+}
@@ -0,0 +1,95 @@
+#include <llvm/Support/CFG.h>
+
+#include <CondensedCFG.h>
+
+namespace MemoryAccessPass {
+
+void CondensedCFG::build(llvm::Function & F,
+		const std::set<const llvm::BasicBlock *> & interesting) {
+	m_nodes.clear();
+	m_representatives.clear();
+	m_successors.clear();
+	if (F.empty()) {
+		return;
+	}
+	m_nodes = interesting;
+	m_nodes.insert(&F.getEntryBlock());
+	// Blocks only gain a representative, or become nodes. Both are
+	// bounded, so this terminates.
+	bool isChanged = true;
+	while (isChanged) {
+		isChanged = false;
+		for (llvm::Function::iterator it = F.begin(), ie = F.end();
+				it != ie; it++) {
+			llvm::BasicBlock * BB = &*it;
+			if (m_nodes.count(BB)) {
+				if (m_representatives[BB] != BB) {
+					m_representatives[BB] = BB;
+					isChanged = true;
+				}
+				continue;
+			}
+			std::set<const llvm::BasicBlock *> incoming;
+			for (llvm::pred_iterator pit = llvm::pred_begin(BB),
+						pie = llvm::pred_end(BB);
+					pit != pie; pit++) {
+				const llvm::BasicBlock * representative =
+						getRepresentative(*pit);
+				if (representative) {
+					incoming.insert(representative);
+				}
+			}
+			if (incoming.size() > 1) {
+				// Merge point of different states: Must be a node
+				m_nodes.insert(BB);
+				m_representatives[BB] = BB;
+				isChanged = true;
+			} else if (incoming.size() == 1) {
+				const llvm::BasicBlock * representative = *incoming.begin();
+				if (m_representatives[BB] != representative) {
+					m_representatives[BB] = representative;
+					isChanged = true;
+				}
+			}
+		}
+	}
+	for (llvm::Function::iterator it = F.begin(), ie = F.end();
+			it != ie; it++) {
+		llvm::BasicBlock * BB = &*it;
+		if (!m_nodes.count(BB)) {
+			continue;
+		}
+		std::set<const llvm::BasicBlock *> sources;
+		for (llvm::pred_iterator pit = llvm::pred_begin(BB),
+					pie = llvm::pred_end(BB);
+				pit != pie; pit++) {
+			const llvm::BasicBlock * representative =
+					getRepresentative(*pit);
+			if (representative && sources.insert(representative).second) {
+				m_successors[representative].push_back(BB);
+			}
+		}
+	}
+}
+
+const llvm::BasicBlock * CondensedCFG::getRepresentative(
+		const llvm::BasicBlock * BB) const {
+	std::map<const llvm::BasicBlock *, const llvm::BasicBlock *>::const_iterator it =
+			m_representatives.find(BB);
+	if (it == m_representatives.end()) {
+		return 0;
+	}
+	return it->second;
+}
+
+const std::vector<llvm::BasicBlock *> & CondensedCFG::getSuccessors(
+		const llvm::BasicBlock * BB) const {
+	std::map<const llvm::BasicBlock *, std::vector<llvm::BasicBlock *> >::const_iterator it =
+			m_successors.find(BB);
+	if (it == m_successors.end()) {
+		return m_empty;
+	}
+	return it->second;
+}
+
+}
@@ -0,0 +1,214 @@
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include <EscapeAnalysis.h>
+
+namespace MemoryAccessPass {
+
+bool PointerBase::join(const PointerBase & other) {
+	bool result = false;
+	if (other.isNonLocal && !isNonLocal) {
+		isNonLocal = true;
+		result = true;
+	}
+	for (std::set<const llvm::AllocaInst *>::const_iterator it = other.allocas.begin(),
+								ie = other.allocas.end();
+			it != ie; it++) {
+		result |= allocas.insert(*it).second;
+	}
+	return result;
+}
+
+PointerBase AllocaEscapeAnalysis::getBase(const llvm::Value * value) const {
+	PointerBase result;
+	if (llvm::isa<llvm::Instruction>(value)) {
+		std::map<const llvm::Value *, PointerBase>::const_iterator it =
+				m_bases.find(value);
+		if (it != m_bases.end()) {
+			result = it->second;
+		}
+		return result;
+	}
+	if (!llvm::isa<llvm::ConstantPointerNull>(value) &&
+			!llvm::isa<llvm::UndefValue>(value)) {
+		result.isNonLocal = true;
+	}
+	return result;
+}
+
+PointerBase AllocaEscapeAnalysis::computeBase(const llvm::Instruction & I) const {
+	PointerBase result;
+	if (const llvm::AllocaInst * alloca = llvm::dyn_cast<llvm::AllocaInst>(&I)) {
+		result.allocas.insert(alloca);
+	} else if (const llvm::GetElementPtrInst * gep =
+			llvm::dyn_cast<llvm::GetElementPtrInst>(&I)) {
+		result = getBase(gep->getPointerOperand());
+	} else if (llvm::isa<llvm::BitCastInst>(&I)) {
+		result = getBase(I.getOperand(0));
+	} else if (const llvm::PHINode * phi = llvm::dyn_cast<llvm::PHINode>(&I)) {
+		for (unsigned idx = 0; idx < phi->getNumIncomingValues(); idx++) {
+			result.join(getBase(phi->getIncomingValue(idx)));
+		}
+	} else if (const llvm::SelectInst * select = llvm::dyn_cast<llvm::SelectInst>(&I)) {
+		result.join(getBase(select->getTrueValue()));
+		result.join(getBase(select->getFalseValue()));
+	} else if (const llvm::LoadInst * load = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+		PointerBase source = getBase(load->getPointerOperand());
+		if (source.isNonLocal) {
+			result.isNonLocal = true;
+			return result;
+		}
+		for (std::set<const llvm::AllocaInst *>::iterator it = source.allocas.begin(),
+								ie = source.allocas.end();
+				it != ie; it++) {
+			if (m_escaped.count(*it)) {
+				result.isNonLocal = true;
+				return result;
+			}
+			std::map<const llvm::AllocaInst *, PointerBase>::const_iterator cit =
+					m_contents.find(*it);
+			if (cit != m_contents.end()) {
+				result.join(cit->second);
+			}
+		}
+	} else {
+		// Call results, integer casts, arguments' derivations...
+		result.isNonLocal = true;
+	}
+	return result;
+}
+
+bool AllocaEscapeAnalysis::escape(const PointerBase & base) {
+	bool result = false;
+	for (std::set<const llvm::AllocaInst *>::const_iterator it = base.allocas.begin(),
+								ie = base.allocas.end();
+			it != ie; it++) {
+		result |= m_escaped.insert(*it).second;
+	}
+	return result;
+}
+
+bool AllocaEscapeAnalysis::addContents(const PointerBase & target,
+		const PointerBase & base) {
+	if (target.isNonLocal) {
+		return escape(base);
+	}
+	bool result = false;
+	for (std::set<const llvm::AllocaInst *>::const_iterator it = target.allocas.begin(),
+								ie = target.allocas.end();
+			it != ie; it++) {
+		if (m_escaped.count(*it)) {
+			result |= escape(base);
+		} else {
+			result |= m_contents[*it].join(base);
+		}
+	}
+	return result;
+}
+
+bool AllocaEscapeAnalysis::visitUses(const llvm::Instruction & I) {
+	if (const llvm::StoreInst * store = llvm::dyn_cast<llvm::StoreInst>(&I)) {
+		const llvm::Value * value = store->getValueOperand();
+		if (!value->getType()->isPointerTy()) {
+			return false;
+		}
+		return addContents(getBase(store->getPointerOperand()), getBase(value));
+	}
+	if (llvm::isa<llvm::LoadInst>(&I) || llvm::isa<llvm::GetElementPtrInst>(&I) ||
+			llvm::isa<llvm::BitCastInst>(&I) || llvm::isa<llvm::PHINode>(&I) ||
+			llvm::isa<llvm::SelectInst>(&I) || llvm::isa<llvm::CmpInst>(&I) ||
+			llvm::isa<llvm::DbgInfoIntrinsic>(&I)) {
+		// Tracked through the bases, or harmless
+		return false;
+	}
+	if (const llvm::IntrinsicInst * intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(&I)) {
+		unsigned id = intrinsic->getIntrinsicID();
+		if ((id == llvm::Intrinsic::lifetime_start) ||
+				(id == llvm::Intrinsic::lifetime_end)) {
+			return false;
+		}
+		if (id == llvm::Intrinsic::memset) {
+			return false;
+		}
+		if ((id == llvm::Intrinsic::memcpy) || (id == llvm::Intrinsic::memmove)) {
+			// The destination may now hold anything the source held
+			const llvm::MemTransferInst * transfer =
+					llvm::cast<llvm::MemTransferInst>(intrinsic);
+			PointerBase source = getBase(transfer->getRawSource());
+			PointerBase contents;
+			if (source.isNonLocal) {
+				contents.isNonLocal = true;
+			}
+			for (std::set<const llvm::AllocaInst *>::iterator it = source.allocas.begin(),
+									ie = source.allocas.end();
+					it != ie; it++) {
+				if (m_escaped.count(*it)) {
+					contents.isNonLocal = true;
+				} else {
+					contents.join(m_contents[*it]);
+				}
+			}
+			return addContents(getBase(transfer->getRawDest()), contents);
+		}
+	}
+	// Calls, returns, ptrtoint, and anything else: Every pointer operand
+	// escapes
+	bool result = false;
+	for (unsigned idx = 0; idx < I.getNumOperands(); idx++) {
+		const llvm::Value * operand = I.getOperand(idx);
+		if (operand->getType()->isPointerTy()) {
+			result |= escape(getBase(operand));
+		}
+	}
+	return result;
+}
+
+void AllocaEscapeAnalysis::run(const llvm::Function & F) {
+	m_bases.clear();
+	m_escaped.clear();
+	m_contents.clear();
+	bool isChanged = true;
+	while (isChanged) {
+		isChanged = false;
+		for (llvm::Function::const_iterator bit = F.begin(), bie = F.end();
+				bit != bie; bit++) {
+			for (llvm::BasicBlock::const_iterator it = bit->begin(), ie = bit->end();
+					it != ie; it++) {
+				if (it->getType()->isPointerTy()) {
+					isChanged |= m_bases[&*it].join(computeBase(*it));
+				}
+				isChanged |= visitUses(*it);
+			}
+		}
+		// What an escaping alloca holds escapes with it
+		for (std::map<const llvm::AllocaInst *, PointerBase>::iterator it = m_contents.begin(),
+										ie = m_contents.end();
+				it != ie; it++) {
+			if (m_escaped.count(it->first)) {
+				isChanged |= escape(it->second);
+			}
+		}
+	}
+}
+
+bool AllocaEscapeAnalysis::isLocal(const llvm::Value * pointer) const {
+	std::map<const llvm::Value *, PointerBase>::const_iterator it =
+			m_bases.find(pointer);
+	if (it == m_bases.end()) {
+		return false;
+	}
+	const PointerBase & base = it->second;
+	if (base.isNonLocal || base.allocas.empty()) {
+		return false;
+	}
+	for (std::set<const llvm::AllocaInst *>::const_iterator ait = base.allocas.begin(),
+								aie = base.allocas.end();
+			ait != aie; ait++) {
+		if (m_escaped.count(*ait)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,300 @@
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+
+#include <FalseSharing.h>
+#include <WorkingSet.h>
+
+namespace MemoryAccessPass {
+
+// Align globals found to falsely share a line to the cache line, and pad
+// them to whole lines
+int MemoryAccessRealignFalseSharing = 0;
+
+struct ThreadCreateFunction {
+	const char * name;
+	unsigned entryArgument;
+};
+
+static const ThreadCreateFunction threadCreateFunctions[] = {
+	{ "pthread_create", 2 },
+	{ "thrd_create", 1 },
+	{ 0, 0 }
+};
+
+void FalseSharing::findRoots(llvm::Module & M, std::vector<llvm::Function *> & roots) {
+	llvm::Function * main = M.getFunction("main");
+	if (main && !main->isDeclaration()) {
+		roots.push_back(main);
+	}
+	for (unsigned idx = 0; threadCreateFunctions[idx].name; idx++) {
+		llvm::Function * create = M.getFunction(threadCreateFunctions[idx].name);
+		if (!create) {
+			continue;
+		}
+		unsigned entryArgument = threadCreateFunctions[idx].entryArgument;
+		for (llvm::Value::use_iterator it = create->use_begin(), ie = create->use_end();
+				it != ie; it++) {
+			llvm::CallInst * ci = llvm::dyn_cast<llvm::CallInst>(*it);
+			if (!ci || (ci->getCalledFunction() != create) ||
+					(ci->getNumArgOperands() <= entryArgument)) {
+				continue;
+			}
+			llvm::Function * entry = llvm::dyn_cast<llvm::Function>(
+					ci->getArgOperand(entryArgument)->stripPointerCasts());
+			if (entry && threadRoots.insert(entry).second) {
+				roots.push_back(entry);
+			}
+		}
+	}
+}
+
+void FalseSharing::addWrites(llvm::Function * root, MemoryAccess & memoryAccess) {
+	std::set<llvm::Function *> reached;
+	std::vector<llvm::Function *> worklist;
+	worklist.push_back(root);
+	reached.insert(root);
+	while (!worklist.empty()) {
+		llvm::Function * F = worklist.back();
+		worklist.pop_back();
+		if (F->isDeclaration()) {
+			continue;
+		}
+		const CanonicalSummary * summary = memoryAccess.getVisitor(F)->canonicalSummary;
+		for (std::vector<const llvm::GlobalValue *>::const_iterator it = summary->globals.begin(),
+										ie = summary->globals.end();
+				it != ie; it++) {
+			if (const llvm::GlobalVariable * global = llvm::dyn_cast<llvm::GlobalVariable>(*it)) {
+				writers[global].insert(root);
+			}
+		}
+		for (llvm::Function::iterator bit = F->begin(), bie = F->end();
+				bit != bie; bit++) {
+			for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+					it != ie; it++) {
+				llvm::CallInst * ci = llvm::dyn_cast<llvm::CallInst>(&*it);
+				llvm::Function * callee = ci ? ci->getCalledFunction() : 0;
+				if (callee && reached.insert(callee).second) {
+					worklist.push_back(callee);
+				}
+			}
+		}
+	}
+}
+
+// Some writer of a may run at the same time as some writer of b
+bool FalseSharing::isConcurrent(const std::set<const llvm::Function *> & a,
+		const std::set<const llvm::Function *> & b) const {
+	for (std::set<const llvm::Function *>::const_iterator ait = a.begin(), aie = a.end();
+			ait != aie; ait++) {
+		for (std::set<const llvm::Function *>::const_iterator bit = b.begin(), bie = b.end();
+				bit != bie; bit++) {
+			if ((*ait != *bit) || threadRoots.count(*ait)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void FalseSharing::place(llvm::Module & M, const llvm::DataLayout & DL,
+		std::map<std::string, std::vector<Placement> > & sections) const {
+	std::map<std::string, uint64_t> ends;
+	for (llvm::Module::global_iterator it = M.global_begin(), ie = M.global_end();
+			it != ie; it++) {
+		const llvm::GlobalVariable * global = &*it;
+		if (!global->hasInitializer() || global->isConstant() ||
+				global->isThreadLocal()) {
+			continue;
+		}
+		std::string section = global->getSection();
+		if (section.empty()) {
+			section = global->getInitializer()->isNullValue() ? ".bss" : ".data";
+		}
+		unsigned alignment = global->getAlignment();
+		if (!alignment) {
+			alignment = DL.getPreferredAlignment(global);
+		}
+		uint64_t & end = ends[section];
+		Placement placement;
+		placement.global = global;
+		placement.offset = (end + alignment - 1) / alignment * alignment;
+		placement.size = DL.getTypeAllocSize(global->getType()->getElementType());
+		end = placement.offset + placement.size;
+		sections[section].push_back(placement);
+	}
+}
+
+bool FalseSharing::runOnModule(llvm::Module &M) {
+	candidates.clear();
+	threadRoots.clear();
+	writers.clear();
+	realignedCount = 0;
+	std::vector<llvm::Function *> roots;
+	findRoots(M, roots);
+	for (unsigned idx = 0; idx < roots.size(); idx++) {
+		if (!roots[idx]->isDeclaration()) {
+			addWrites(roots[idx], getAnalysis<MemoryAccess>(*roots[idx]));
+		}
+	}
+	for (std::map<const llvm::GlobalVariable *, std::set<const llvm::Function *> >::iterator it = writers.begin(),
+												ie = writers.end();
+			it != ie; it++) {
+		if (isConcurrent(it->second, it->second)) {
+			FalseSharingCandidate candidate;
+			candidate.first = it->first;
+			candidate.second = 0;
+			candidate.roots = it->second;
+			candidates.push_back(candidate);
+		}
+	}
+	const llvm::DataLayout & DL = getAnalysis<llvm::DataLayout>();
+	uint64_t lineBytes = MemoryAccessCacheLineBytes;
+	std::map<std::string, std::vector<Placement> > sections;
+	place(M, DL, sections);
+	std::set<llvm::GlobalVariable *> realign;
+	for (std::map<std::string, std::vector<Placement> >::iterator sit = sections.begin(),
+									sie = sections.end();
+			sit != sie; sit++) {
+		std::vector<Placement> & placements = sit->second;
+		for (unsigned first = 0; first < placements.size(); first++) {
+			std::map<const llvm::GlobalVariable *, std::set<const llvm::Function *> >::iterator fit =
+					writers.find(placements[first].global);
+			if ((fit == writers.end()) || (placements[first].size == 0)) {
+				continue;
+			}
+			uint64_t lastLine = (placements[first].offset + placements[first].size - 1) / lineBytes;
+			// Later globals starting on first's last line
+			for (unsigned second = first + 1; (second < placements.size()) &&
+					(placements[second].offset / lineBytes <= lastLine); second++) {
+				std::map<const llvm::GlobalVariable *, std::set<const llvm::Function *> >::iterator wit =
+						writers.find(placements[second].global);
+				if ((wit == writers.end()) || !isConcurrent(fit->second, wit->second)) {
+					continue;
+				}
+				FalseSharingCandidate candidate;
+				candidate.first = fit->first;
+				candidate.second = wit->first;
+				candidate.roots = fit->second;
+				candidate.roots.insert(wit->second.begin(), wit->second.end());
+				candidates.push_back(candidate);
+				realign.insert(const_cast<llvm::GlobalVariable *>(fit->first));
+				realign.insert(const_cast<llvm::GlobalVariable *>(wit->first));
+			}
+		}
+	}
+	if (!MemoryAccessRealignFalseSharing) {
+		return false;
+	}
+	// Candidates refer to the globals replaced by padded ones
+	std::map<const llvm::GlobalVariable *, const llvm::GlobalVariable *> replaced;
+	for (std::set<llvm::GlobalVariable *>::iterator it = realign.begin(), ie = realign.end();
+			it != ie; it++) {
+		llvm::GlobalVariable * global = *it;
+		if (!global->hasLocalLinkage()) {
+			continue;
+		}
+		bool isRealigned = false;
+		if (global->getAlignment() < lineBytes) {
+			global->setAlignment(lineBytes);
+			isRealigned = true;
+		}
+		llvm::GlobalVariable * padded = pad(global, DL, lineBytes);
+		if (padded != global) {
+			replaced[global] = padded;
+			isRealigned = true;
+		}
+		if (isRealigned) {
+			realignedCount++;
+		}
+	}
+	for (std::vector<FalseSharingCandidate>::iterator it = candidates.begin(),
+							ie = candidates.end();
+			it != ie; it++) {
+		if (replaced.count(it->first)) {
+			it->first = replaced[it->first];
+		}
+		if (it->second && replaced.count(it->second)) {
+			it->second = replaced[it->second];
+		}
+	}
+	writers.clear();
+	return realignedCount > 0;
+}
+
+// Aligning to the line only separates the start of global. Pads it to
+// whole lines, so that nothing placed after it shares its last line.
+// The padded global takes global's place, name and uses.
+llvm::GlobalVariable * FalseSharing::pad(llvm::GlobalVariable * global,
+		const llvm::DataLayout & DL, uint64_t lineBytes) {
+	llvm::Type * type = global->getType()->getElementType();
+	uint64_t size = DL.getTypeAllocSize(type);
+	uint64_t padding = (lineBytes - size % lineBytes) % lineBytes;
+	if (!padding) {
+		return global;
+	}
+	llvm::LLVMContext & context = global->getContext();
+	llvm::ArrayType * paddingType = llvm::ArrayType::get(
+			llvm::Type::getInt8Ty(context), padding);
+	llvm::Type * fields[] = { type, paddingType };
+	llvm::StructType * paddedType = llvm::StructType::get(context, fields);
+	llvm::Constant * values[] = {
+		global->getInitializer(), llvm::Constant::getNullValue(paddingType)
+	};
+	llvm::GlobalVariable * padded = new llvm::GlobalVariable(*global->getParent(),
+			paddedType, global->isConstant(), global->getLinkage(),
+			llvm::ConstantStruct::get(paddedType, values), "", global,
+			global->getThreadLocalMode(), global->getType()->getAddressSpace());
+	padded->setAlignment(global->getAlignment());
+	padded->setSection(global->getSection());
+	padded->setVisibility(global->getVisibility());
+	padded->setUnnamedAddr(global->hasUnnamedAddr());
+	padded->takeName(global);
+	llvm::Constant * zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 0);
+	llvm::Constant * indices[] = { zero, zero };
+	global->replaceAllUsesWith(
+			llvm::ConstantExpr::getInBoundsGetElementPtr(padded, indices));
+	global->eraseFromParent();
+	return padded;
+}
+
+void FalseSharing::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+	AU.addRequired<llvm::DataLayout>();
+	AU.addRequired<MemoryAccess>();
+	if (!MemoryAccessRealignFalseSharing) {
+		AU.setPreservesAll();
+	}
+}
+
+static void printRoots(llvm::raw_ostream &O, const std::set<const llvm::Function *> & roots) {
+	for (std::set<const llvm::Function *>::const_iterator it = roots.begin(), ie = roots.end();
+			it != ie; it++) {
+		O << " " << (*it)->getName();
+	}
+}
+
+void FalseSharing::print(llvm::raw_ostream &O, const llvm::Module *M) const {
+	O << "False sharing candidates (line " << MemoryAccessCacheLineBytes <<
+			" bytes, direct calls only):\n";
+	for (std::vector<FalseSharingCandidate>::const_iterator it = candidates.begin(),
+								ie = candidates.end();
+			it != ie; it++) {
+		if (it->second) {
+			O << "\t" << it->first->getName() << " and " << it->second->getName() <<
+					" may share a line. Written from:";
+		} else {
+			O << "\t" << it->first->getName() << " written from:";
+		}
+		printRoots(O, it->roots);
+		O << "\n";
+	}
+	if (MemoryAccessRealignFalseSharing) {
+		O << "Realigned " << realignedCount << " globals (local linkage only)\n";
+	}
+}
+
+char FalseSharing::ID = 0;
+static llvm::RegisterPass<FalseSharing> _X(
+		"memfalsesharing",
+		"Find globals written from several threads that may share cache lines",
+		false, false);
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <list>
 #include <set>
@@ -6,19 +7,24 @@
 #include <iostream>
 #include <sstream>
 
+#include <llvm/ADT/Twine.h>
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/AliasSetTracker.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/DebugInfo.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <MemoryAccess.h>
 #include <MemoryAccessInstVisitor.h>
+#include <IndirectCallIndex.h>
 
 namespace MemoryAccessPass {
 
@@ -52,9 +58,48 @@ bool isPredefinedFunction(llvm::Function & F) {
 	return false;
 }
 
+// Declarations known not to modify memory visible to the caller. Not exit,
+// which runs atexit handlers, nor free, which ends the object's lifetime.
+static const char * nonModifyingFunctions[] = {
+	"__assert_fail",
+	"_exit",
+	"malloc",
+	0
+};
+
+static bool isNonModifyingFunction(llvm::Function & F) {
+	if (unsigned id = F.getIntrinsicID()) {
+		return (id == llvm::Intrinsic::lifetime_start) ||
+				(id == llvm::Intrinsic::lifetime_end) ||
+				(id == llvm::Intrinsic::dbg_declare) ||
+				(id == llvm::Intrinsic::dbg_value);
+	}
+	llvm::StringRef name = F.getName();
+	for (int idx = 0; nonModifyingFunctions[idx]; idx++) {
+		if (name.equals(nonModifyingFunctions[idx])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// If non-zero, summaries over this many bytes are compacted, least
+// recently used first, and compacted summaries are evicted to a spill file
+uint64_t MemoryAccessSummaryMemoryCap = 0;
+// Spill file. If not set, an anonymous temporary file
+const char * MemoryAccessSpillPath = 0;
+// If non-zero, indirect calls with up to this many candidate callees are
+// joined over all of them
+int MemoryAccessIndirectCallFanout = 0;
+// Narrow calls through vtable slots to the functions in that slot
+int MemoryAccessNarrowVirtualCalls = 0;
 
 MemoryAccess::MemoryAccess() :
-		llvm::FunctionPass(ID), lastVisitor(0) {}
+		llvm::FunctionPass(ID), lastVisitor(0), residentBytes(0),
+		spillFile(0), isSpillFailed(false), computeDepth(0),
+		isDropCalleeData(false), indirectCallIndex(0),
+		indexedModule(0) {}
 
 MemoryAccess::~MemoryAccess() {
 	for (std::map<llvm::Function *, MemoryAccessInstVisitor *>::iterator
@@ -63,6 +108,8 @@ MemoryAccess::~MemoryAccess() {
 		delete it->second;
 		it->second = 0;
 	}
+	delete spillFile;
+	delete indirectCallIndex;
 }
 
 bool MemoryAccess::runOnFunction(llvm::Function &F) {
@@ -83,14 +130,139 @@ const MemoryAccessData * MemoryAccess::getSummaryData() const {
 MemoryAccessInstVisitor * MemoryAccess::getModifiableVisitor(llvm::Function *F) {
 	MemoryAccessInstVisitor * visitor = visitors[F];
 	if (!visitor) {
-		visitor = new MemoryAccessInstVisitor();
+		// Lazily loaded modules: Bring in the body on first use.
+		bool isMaterialized = false;
+		if (F->isMaterializable()) {
+			std::string error;
+			if (F->Materialize(&error)) {
+				llvm::errs() << "Failed to materialize " << F->getName() <<
+						": " << error << "\n";
+			} else {
+				isMaterialized = true;
+			}
+		}
+		visitor = new MemoryAccessInstVisitor(&numbering);
 		visitors[F] = visitor;
 		MemoryAccessCacheDuck<MemoryAccess> cache(*this);
+		++computeDepth;
 		visitor->runOnFunction(*F, &cache);
+		--computeDepth;
+		CanonicalSummary summary;
+		summary.build(*visitor);
+		visitor->canonicalSummary = summaries.intern(summary);
+		if (isDropCalleeData && (computeDepth > 0) && !pinnedFunctions.count(F)) {
+			// Only needed through its callers' summaries, which
+			// share the interned copy
+			visitor->dropCallerInvisibleData();
+			if (isMaterialized) {
+				// Callers asking for F directly release it
+				// themselves
+				release(F);
+			}
+		}
+	} else if (visitor->isEvicted()) {
+		reload(visitor);
+	}
+	if (visitor->canonicalSummary) {
+		// Otherwise, still being computed further up the stack
+		touch(visitor);
 	}
 	return visitor;
 }
 
+void MemoryAccess::touch(MemoryAccessInstVisitor * visitor) {
+	if (!MemoryAccessSummaryMemoryCap) {
+		return;
+	}
+	std::map<MemoryAccessInstVisitor *,
+			std::list<MemoryAccessInstVisitor *>::iterator>::iterator pit =
+					residentPositions.find(visitor);
+	if (pit != residentPositions.end()) {
+		residentVisitors.splice(residentVisitors.begin(),
+				residentVisitors, pit->second);
+		return;
+	}
+	residentVisitors.push_front(visitor);
+	residentPositions[visitor] = residentVisitors.begin();
+	residentBytes += estimateMemoryUsage(*visitor->functionData);
+	std::list<MemoryAccessInstVisitor *>::iterator it = residentVisitors.end();
+	while ((residentBytes > MemoryAccessSummaryMemoryCap) &&
+			(it != residentVisitors.begin())) {
+		--it;
+		MemoryAccessInstVisitor * victim = *it;
+		if ((victim == visitor) || (victim == lastVisitor)) {
+			continue;
+		}
+		compact(victim);
+		residentPositions.erase(victim);
+		it = residentVisitors.erase(it);
+	}
+	while ((residentBytes > MemoryAccessSummaryMemoryCap) &&
+			!flatVisitors.empty()) {
+		MemoryAccessInstVisitor * victim = flatVisitors.back();
+		if (!spill(victim)) {
+			break;
+		}
+		flatPositions.erase(victim);
+		flatVisitors.pop_back();
+	}
+}
+
+void MemoryAccess::compact(MemoryAccessInstVisitor * visitor) {
+	// Cached, so it survives losing functionData
+	visitor->isSummariseFunction();
+	residentBytes -= estimateMemoryUsage(*visitor->functionData);
+	visitor->flatData = new FlatSummary();
+	visitor->flatData->flatten(*visitor->functionData);
+	residentBytes += estimateMemoryUsage(*visitor->flatData);
+	delete visitor->functionData;
+	visitor->functionData = 0;
+	flatVisitors.push_front(visitor);
+	flatPositions[visitor] = flatVisitors.begin();
+}
+
+// False if the summary must stay in memory
+bool MemoryAccess::spill(MemoryAccessInstVisitor * visitor) {
+	if (visitor->spillOffset < 0) {
+		if (isSpillFailed) {
+			return false;
+		}
+		if (!spillFile) {
+			spillFile = new SummarySpillFile(MemoryAccessSpillPath);
+		}
+		visitor->spillOffset = spillFile->write(*visitor->flatData);
+		if (visitor->spillOffset < 0) {
+			llvm::errs() << "Failed to write to the summary spill file. "
+					"Keeping summaries in memory.\n";
+			isSpillFailed = true;
+			return false;
+		}
+	}
+	residentBytes -= estimateMemoryUsage(*visitor->flatData);
+	delete visitor->flatData;
+	visitor->flatData = 0;
+	return true;
+}
+
+void MemoryAccess::reload(MemoryAccessInstVisitor * visitor) {
+	if (visitor->flatData) {
+		forget(visitor);
+		visitor->functionData = new MemoryAccessData(0, visitor->numbering);
+		visitor->flatData->inflate(*visitor->functionData);
+		delete visitor->flatData;
+		visitor->flatData = 0;
+		return;
+	}
+	FlatSummary flat;
+	if (!spillFile->read(visitor->spillOffset, flat)) {
+		// Not recoverable: The summary was freed when it was spilled
+		llvm::report_fatal_error("Failed to read the summary of " +
+				visitor->function->getName() + " from the spill file");
+	}
+	visitor->functionData = new MemoryAccessData(0, visitor->numbering);
+	flat.inflate(*visitor->functionData);
+}
+
 const MemoryAccessInstVisitor * MemoryAccess::getVisitor(llvm::Function *F) {
 	return getModifiableVisitor(F);
 }
@@ -102,6 +274,247 @@ void MemoryAccess::clear() {
 		delete it->second;
 	}
 	visitors.clear();
+	residentVisitors.clear();
+	residentPositions.clear();
+	flatVisitors.clear();
+	flatPositions.clear();
+	residentBytes = 0;
+	lastVisitor = 0;
+	pinnedFunctions.clear();
+	callers.clear();
+	callees.clear();
+	summaries.clear();
+	numbering.clear();
+	delete indirectCallIndex;
+	indirectCallIndex = 0;
+	indexedModule = 0;
+}
+
+void MemoryAccess::forget(MemoryAccessInstVisitor * visitor) {
+	std::map<MemoryAccessInstVisitor *,
+			std::list<MemoryAccessInstVisitor *>::iterator>::iterator pit =
+					residentPositions.find(visitor);
+	if (pit != residentPositions.end()) {
+		residentBytes -= estimateMemoryUsage(*visitor->functionData);
+		residentVisitors.erase(pit->second);
+		residentPositions.erase(pit);
+	}
+	pit = flatPositions.find(visitor);
+	if (pit != flatPositions.end()) {
+		residentBytes -= estimateMemoryUsage(*visitor->flatData);
+		flatVisitors.erase(pit->second);
+		flatPositions.erase(pit);
+	}
+}
+
+void MemoryAccess::addCaller(llvm::Function *callee, llvm::Function *caller) {
+	callers[callee].insert(caller);
+	callees[caller].insert(callee);
+}
+
+void MemoryAccess::removeCaller(llvm::Function *caller) {
+	std::map<llvm::Function *, std::set<llvm::Function *> >::iterator it =
+			callees.find(caller);
+	if (it == callees.end()) {
+		return;
+	}
+	for (std::set<llvm::Function *>::iterator fit = it->second.begin(),
+							fie = it->second.end();
+			fit != fie; fit++) {
+		std::map<llvm::Function *, std::set<llvm::Function *> >::iterator cit =
+				callers.find(*fit);
+		if (cit == callers.end()) {
+			continue;
+		}
+		cit->second.erase(caller);
+		if (cit->second.empty()) {
+			callers.erase(cit);
+		}
+	}
+	callees.erase(it);
+}
+
+bool MemoryAccess::getIndirectCallees(const llvm::CallInst & ci,
+		std::vector<llvm::Function *> & callees) {
+	if (MemoryAccessIndirectCallFanout <= 0) {
+		return false;
+	}
+	llvm::Module * M = const_cast<llvm::Module *>(
+			ci.getParent()->getParent()->getParent());
+	if (!indirectCallIndex || (indexedModule != M)) {
+		delete indirectCallIndex;
+		indirectCallIndex = new llvm::IndirectCallIndex();
+		indirectCallIndex->build(*M, MemoryAccessNarrowVirtualCalls);
+		indexedModule = M;
+	}
+	return indirectCallIndex->getCallees(ci, callees,
+			MemoryAccessIndirectCallFanout);
+}
+
+void MemoryAccess::invalidate(llvm::Function *F) {
+	std::vector<llvm::Function *> worklist(1, F);
+	std::set<llvm::Function *> queued(worklist.begin(), worklist.end());
+	while (!worklist.empty()) {
+		llvm::Function * current = worklist.back();
+		worklist.pop_back();
+		queued.erase(current);
+		std::map<llvm::Function *, MemoryAccessInstVisitor *>::iterator it =
+				visitors.find(current);
+		if ((it == visitors.end()) || !it->second) {
+			// Never summarised: No one depends on it
+			continue;
+		}
+		MemoryAccessInstVisitor * old = it->second;
+		forget(old);
+		visitors.erase(it);
+		if (current == F) {
+			numbering.forget(F);
+		}
+		removeCaller(current);
+		MemoryAccessInstVisitor * visitor = getModifiableVisitor(current);
+		// Callers only see the canonical summary, which is interned
+		bool isChanged = (old->canonicalSummary != visitor->canonicalSummary);
+		if (lastVisitor == old) {
+			lastVisitor = visitor;
+		}
+		delete old;
+		if (!isChanged) {
+			continue;
+		}
+		std::map<llvm::Function *, std::set<llvm::Function *> >::iterator cit =
+				callers.find(current);
+		if (cit == callers.end()) {
+			continue;
+		}
+		for (std::set<llvm::Function *>::iterator fit = cit->second.begin(),
+								fie = cit->second.end();
+				fit != fie; fit++) {
+			if (queued.insert(*fit).second) {
+				worklist.push_back(*fit);
+			}
+		}
+	}
+}
+
+const ModRefSummary & MemoryAccess::getModRefSummary(llvm::Function *F) {
+	MemoryAccessInstVisitor * visitor = getModifiableVisitor(F);
+	if (visitor->modRefSummary) {
+		return *visitor->modRefSummary;
+	}
+	// Installed before recursing into callees, so that recursive calls
+	// see a conservative summary
+	ModRefSummary * summary = new ModRefSummary();
+	summary->setModifiesAnything();
+	visitor->modRefSummary = summary;
+	ModRefSummary result;
+	if (isNonModifyingFunction(*F)) {
+		*summary = result;
+		return *summary;
+	}
+	if (F->isDeclaration() || visitor->haveIHadEnough) {
+		return *summary;
+	}
+	result.build(*visitor->functionData);
+	// Copied: Recursing may evict this visitor's summary
+	std::vector<llvm::Function *> callees;
+	const CallInstSet & calls = visitor->functionData->functionCalls;
+	for (CallInstSet::const_iterator it = calls.begin(),
+								ie = calls.end();
+			it != ie; it++) {
+		callees.push_back((*it)->getCalledFunction());
+	}
+	callees.insert(callees.end(), visitor->indirectCallees.begin(),
+			visitor->indirectCallees.end());
+	for (std::vector<llvm::Function *>::iterator it = callees.begin(),
+							ie = callees.end();
+			(it != ie) && !result.isModifiesAnything(); it++) {
+		if (getModRefSummary(*it).isModifiesAnything()) {
+			result.setModifiesAnything();
+		}
+	}
+	*summary = result;
+	return *summary;
+}
+
+bool MemoryAccess::mayModifyGlobal(llvm::Function & F, llvm::GlobalValue * global) {
+	return getModRefSummary(&F).mayModifyGlobal(global);
+}
+
+bool MemoryAccess::mayModify(llvm::CallInst & ci, llvm::Value * pointer) {
+	std::vector<llvm::Value *> pointers(1, pointer);
+	std::vector<bool> result;
+	mayModify(ci, pointers, result);
+	return result[0];
+}
+
+void MemoryAccess::mayModify(llvm::CallInst & ci,
+		const std::vector<llvm::Value *> & pointers,
+		std::vector<bool> & result) {
+	result.assign(pointers.size(), true);
+	llvm::Function * callee = ci.getCalledFunction();
+	if (!callee) {
+		return;
+	}
+	const ModRefSummary & summary = getModRefSummary(callee);
+	if (summary.isModifiesAnything()) {
+		return;
+	}
+	// Objects the callee may write through its arguments. Computed once
+	// for the whole batch.
+	std::vector<const llvm::Value *> argumentObjects;
+	bool isUnidentifiedArgumentObject = false;
+	const std::vector<unsigned> & arguments = summary.getModifiedArguments();
+	for (std::vector<unsigned>::const_iterator it = arguments.begin(),
+							ie = arguments.end();
+			it != ie; it++) {
+		if (*it >= ci.getNumArgOperands()) {
+			// Written through a vararg. Can't tell which.
+			return;
+		}
+		llvm::Value * object = llvm::GetUnderlyingObject(ci.getArgOperand(*it));
+		if (!llvm::isIdentifiedObject(object)) {
+			isUnidentifiedArgumentObject = true;
+		}
+		argumentObjects.push_back(object);
+	}
+	for (unsigned idx = 0; idx < pointers.size(); idx++) {
+		llvm::Value * object = llvm::GetUnderlyingObject(pointers[idx]);
+		bool isIdentified = llvm::isIdentifiedObject(object);
+		bool isModified = false;
+		if (llvm::GlobalValue * global = llvm::dyn_cast<llvm::GlobalValue>(object)) {
+			isModified = summary.mayModifyGlobal(global);
+		} else if (!isIdentified) {
+			// May point to any global
+			isModified = summary.isModifiesGlobals();
+		}
+		if (!isModified && !argumentObjects.empty()) {
+			if (isUnidentifiedArgumentObject || !isIdentified) {
+				isModified = true;
+			} else {
+				isModified = (std::find(argumentObjects.begin(),
+						argumentObjects.end(), object) !=
+						argumentObjects.end());
+			}
+		}
+		result[idx] = isModified;
+	}
+}
+
+void MemoryAccess::release(llvm::Function *F) {
+	if (!F->isDematerializable()) {
+		return;
+	}
+	// Needs the callees, which are dropped below
+	getModRefSummary(F);
+	MemoryAccessInstVisitor * visitor = getModifiableVisitor(F);
+	visitor->detachFromBody(*F);
+	F->Dematerialize();
+	numbering.forget(F);
+	pinnedFunctions.erase(F);
+}
+
+void MemoryAccess::pin(llvm::Function *F) {
+	pinnedFunctions.insert(F);
 }
 
 void MemoryAccess::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
@@ -135,6 +548,19 @@ void MemoryAccess::print(llvm::raw_ostream &O, const MemoryAccessData & data,
 	}
 }
 void MemoryAccess::print(llvm::raw_ostream &O, const MemoryAccessData & data) const {
+	printData(O, data);
+	O << "Is summarise: " << isSummariseFunction() << "\n";
+	O << "Alias analysis info:\n";
+	printAA(O);
+}
+
+void MemoryAccess::print(llvm::raw_ostream &O, const MemoryAccessInstVisitor & visitor) const {
+	O << "Function " << visitor.function->getName() << ":\n";
+	printData(O, *visitor.functionData);
+	O << "Is summarise: " << visitor.isSummariseFunction() << "\n";
+}
+
+void MemoryAccess::printData(llvm::raw_ostream &O, const MemoryAccessData & data) const {
 	O << "Stores to stack:\n";
 	print(O, data, data.stackStores);
 	O << "Stores to globals:\n";
@@ -146,7 +572,7 @@ void MemoryAccess::print(llvm::raw_ostream &O, const MemoryAccessData & data) co
 	O << "Stores to THE UNKNOWN:\n";
 	print(O, data, data.unknownStores);
 	O << "Function calls: Indirect: " << data.indirectFunctionCalls.size() << " Direct:\n";
-	for (std::set<const llvm::CallInst *>::iterator it = data.functionCalls.begin(),
+	for (CallInstSet::iterator it = data.functionCalls.begin(),
 								ie = data.functionCalls.end();
 			it != ie; it++) {
 		const llvm::CallInst * ci = *it;
@@ -157,9 +583,6 @@ void MemoryAccess::print(llvm::raw_ostream &O, const MemoryAccessData & data) co
 	print(O, data.temporaries);
 	O << "Stores:\n";
 	print(O, data.stores);
-	O << "Is summarise: " << isSummariseFunction() << "\n";
-	O << "Alias analysis info:\n";
-	printAA(O);
 }
 
 void MemoryAccess::printAA(llvm::raw_ostream &O) const {
@@ -1,10 +1,15 @@
 #include <algorithm>
 #include <cassert>
 
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <ChaoticIteration.h>
+#include <CondensedCFG.h>
 #include <MemoryAccessInstVisitor.h>
+#include <SparseIteration.h>
+#include <SummarySpill.h>
 
 namespace MemoryAccessPass {
 
@@ -14,20 +19,35 @@ int MemoryAccessArgumentAccessWatermark = 10;
 int MemoryAccessGlobalAccessWatermark = 0;
 int MemoryAccessFunctionCallCountWatermark = 10;
 int VisitBlockCountWatermark = 10;
+// Use SparseIteration instead of ChaoticIteration. Blocks without memory
+// effects are not visited, and do not count against VisitBlockCountWatermark
+int MemoryAccessSparseIteration = 0;
+// Run ChaoticIteration over a CondensedCFG of the blocks with memory effects
+int MemoryAccessCondenseCFG = 0;
+// Join stores along an edge only over the entries that changed at either
+// end since that edge was last joined. ChaoticIteration then queues blocks
+// with what changed in them.
+int MemoryAccessDeltaJoin = 0;
+// If non-zero, an entry of stores that changed this many times is widened
+// to top, and stays top
+int MemoryAccessWideningThreshold = 0;
+// Stores through pointers the evaluator can't classify, that can only point
+// into allocas which don't escape the function, are stack stores
+int MemoryAccessEscapeAnalysis = 1;
 
 StoredValue StoredValue::top = StoredValue();
 
 StoredValue Evaluator::visitGlobalValue(llvm::GlobalValue & globalValue) {
 	llvm::Value * value = &globalValue;
 	StoredValue result(value, StoredValueTypeGlobal);
-	m_cache.insert(std::make_pair(value, result));
+	m_cache.insert(value, result);
 	return result;
 }
 
 StoredValue Evaluator::visitAllocaInst(llvm::AllocaInst & allocaInst) {
 	llvm::Value * value = &allocaInst;
 	StoredValue result(value, StoredValueTypeStack);
-	m_cache.insert(std::make_pair(value, result));
+	m_cache.insert(value, result);
 	return result;
 }
 
@@ -48,7 +68,7 @@ StoredValue Evaluator::visitGetElementPtrInst(llvm::GetElementPtrInst & gepInst)
 	llvm::Value * pointer = gepInst.getPointerOperand();
 	StoredValue result = visit(pointer);
 	result.value = &gepInst;
-	m_cache.insert(std::make_pair(&gepInst, result));
+	m_cache.insert(&gepInst, result);
 	return result;
 }
 
@@ -56,14 +76,29 @@ StoredValue Evaluator::visitArgument(llvm::Argument & argument) {
 	StoredValueType type = argument.getType()->isPointerTy() ?
 			StoredValueTypeArgument : StoredValueTypePrimitive;
 	StoredValue result(&argument, type);
-	m_cache.insert(std::make_pair(&argument, result));
+	m_cache.insert(&argument, result);
 	return result;
 }
 
+// As the instruction it stands for, whose operands are all constant. No
+// instruction is created, so that the result only refers to the module.
 StoredValue Evaluator::visitConstantExpr(llvm::ConstantExpr & constantExpr) {
-	llvm::Instruction * instruction = constantExpr.getAsInstruction();
-	m_instsToDestroy.push_back(instruction);
-	return visit(instruction);
+	StoredValue result(&constantExpr, StoredValueTypeUnknown);
+	llvm::Value * operand = constantExpr.getOperand(0);
+	if (constantExpr.getOpcode() == llvm::Instruction::GetElementPtr) {
+		result.type = visit(operand).type;
+	} else if (constantExpr.isCast()) {
+		if (!constantExpr.getType()->isPointerTy()) {
+			result.type = StoredValueTypeConstant;
+		} else if (operand->getType()->isPointerTy()) {
+			result.type = visit(operand).type;
+		}
+	} else if (llvm::Instruction::isBinaryOp(constantExpr.getOpcode()) &&
+			!constantExpr.getType()->isPointerTy()) {
+		result.type = StoredValueTypeConstant;
+	}
+	m_cache.insert(&constantExpr, result);
+	return result;
 }
 
 StoredValue Evaluator::visitCastInst(llvm::CastInst & ci) {
@@ -83,7 +118,7 @@ StoredValue Evaluator::visitCastInst(llvm::CastInst & ci) {
 	}
 	StoredValue result(&ci, type);
 	if (isConstParams) {
-		m_cache.insert(std::make_pair(&ci, result));
+		m_cache.insert(&ci, result);
 	}
 	return result;
 }
@@ -120,7 +155,7 @@ StoredValue Evaluator::visitBinaryOperator(llvm::BinaryOperator & bo) {
 	}
 	StoredValue result(&bo, type);
 	if (isOp0Const && isOp1Const) {
-		m_cache.insert(std::make_pair(&bo, result));
+		m_cache.insert(&bo, result);
 	}
 	return result;
 }
@@ -152,37 +187,172 @@ StoredValue Evaluator::visitCallInst(llvm::CallInst & ci) {
 	return result;
 }
 
-MemoryAccessData::MemoryAccessData() : m_evaluator(stores, temporaries) {}
+MemoryAccessData::MemoryAccessData(llvm::BumpPtrAllocator * arena,
+		ValueNumbering * numbering) :
+		m_evaluator(stores, temporaries),
+		stackStores(ValueNumberLess(numbering), ValueSet::allocator_type(arena)),
+		globalStores(ValueNumberLess(numbering), ValueSet::allocator_type(arena)),
+		argumentStores(ValueNumberLess(numbering), ValueSet::allocator_type(arena)),
+		heapStores(ValueNumberLess(numbering), ValueSet::allocator_type(arena)),
+		unknownStores(ValueNumberLess(numbering), ValueSet::allocator_type(arena)),
+		temporaries(ValueNumberLess(numbering), StoreBaseToValueMap::allocator_type(arena)),
+		stores(ValueNumberLess(numbering), StoreBaseToValueMap::allocator_type(arena)),
+		functionCalls(ValueNumberLess(numbering), CallInstSet::allocator_type(arena)),
+		indirectFunctionCalls(ValueNumberLess(numbering), CallInstSet::allocator_type(arena)),
+		storesLog(ArenaAllocator<const llvm::Value*>(arena)),
+		storesChangeCount(std::less<const llvm::Value*>(),
+				ArenaAllocator<std::pair<const llvm::Value* const, unsigned> >(arena)) {}
 MemoryAccessData::~MemoryAccessData() {}
 
-MemoryAccessInstVisitor::MemoryAccessInstVisitor() :
+MemoryAccessInstVisitor::MemoryAccessInstVisitor(ValueNumbering * numbering) :
 		llvm::InstVisitor<MemoryAccessInstVisitor>(),
 		visitBlockCount(0), haveIHadEnough(false),
 		function(0), functionData(0),
-		isSummariseFunctionCache(Tristate_Unknown) {}
+		isSummariseFunctionCache(Tristate_Unknown),
+		modRefSummary(0), canonicalSummary(0), numbering(numbering),
+		escapeAnalysis(0), flatData(0), spillOffset(-1) {}
 
 MemoryAccessInstVisitor::~MemoryAccessInstVisitor() {
+	releaseBlockData();
+	delete modRefSummary;
 	delete functionData;
+	delete flatData;
+}
+
+void MemoryAccessInstVisitor::releaseBlockData() {
 	for (std::map<const llvm::BasicBlock*, MemoryAccessData*>::iterator it = data.begin(),
 										ie = data.end();
 			it != ie; it++) {
-		MemoryAccessData * data = it->second;
-		delete data;
+		// Everything in data lives in the arena. No need to run the
+		// destructors.
 		it->second = 0;
 	}
+	data.clear();
+	dataOwners.clear();
+	edgeCursors.clear();
+	arena.Reset();
 }
 
 void MemoryAccessInstVisitor::runOnFunction(llvm::Function & F, MemoryAccessCache * cache) {
 	assert((!functionData) && "MemoryAccessInstVisitor::runOnFunction called more than once");
 	if (isPredefinedFunction(F)) {
-		functionData = new MemoryAccessData();
+		function = &F;
+		functionData = new MemoryAccessData(0, numbering);
 		haveIHadEnough = true;
 		isSummariseFunctionCache = Tristate_False;
 		return;
 	}
-	ChaoticIteration<MemoryAccessInstVisitor> chaoticIteration(*this);
-	chaoticIteration.iterate(F);
+	if (numbering) {
+		numbering->numberFunction(F);
+	}
+	if (MemoryAccessEscapeAnalysis) {
+		escapeAnalysis = new AllocaEscapeAnalysis();
+		escapeAnalysis->run(F);
+	}
+	if (MemoryAccessSparseIteration) {
+		SparseIteration<MemoryAccessInstVisitor> sparseIteration(*this);
+		sparseIteration.iterate(F);
+	} else if (MemoryAccessCondenseCFG) {
+		std::set<const llvm::BasicBlock*> effectBlocks;
+		for (llvm::Function::iterator it = F.begin(), ie = F.end();
+				it != ie; it++) {
+			if (hasMemoryEffects(*it)) {
+				effectBlocks.insert(&*it);
+			}
+		}
+		CondensedCFG cfg;
+		cfg.build(F, effectBlocks);
+		for (llvm::Function::iterator it = F.begin(), ie = F.end();
+				it != ie; it++) {
+			const llvm::BasicBlock * representative = cfg.getRepresentative(&*it);
+			if (representative) {
+				setDataOwner(&*it, representative);
+			}
+		}
+		ChaoticIteration<MemoryAccessInstVisitor> chaoticIteration(*this, cfg);
+		if (MemoryAccessDeltaJoin) {
+			chaoticIteration.iterateDeltas(F);
+		} else {
+			chaoticIteration.iterate(F);
+		}
+	} else {
+		ChaoticIteration<MemoryAccessInstVisitor> chaoticIteration(*this);
+		if (MemoryAccessDeltaJoin) {
+			chaoticIteration.iterateDeltas(F);
+		} else {
+			chaoticIteration.iterate(F);
+		}
+	}
+	delete escapeAnalysis;
+	escapeAnalysis = 0;
 	join(cache);
+	// Only the summary is needed from here on
+	releaseBlockData();
+	compactSummary();
+}
+
+void MemoryAccessInstVisitor::compactSummary() {
+	// Bookkeeping of the fixpoint. Not needed once summarised.
+	functionData->storesLog.clear();
+	std::vector<const llvm::Value*, ArenaAllocator<const llvm::Value*> >(
+			functionData->storesLog.get_allocator()).swap(functionData->storesLog);
+	functionData->storesChangeCount.clear();
+}
+
+// Rewrite the summary so that it doesn't refer to anything inside F's body,
+// which may then be dematerialized. Entries that callers can't see are
+// dropped. Entries callers only use as markers are replaced by F's handle.
+void MemoryAccessInstVisitor::detachFromBody(llvm::Function & F) {
+	// Cached, so it survives dropping functionCalls
+	isSummariseFunction();
+	MemoryAccessData & data = *functionData;
+	ValueSet globalStores(data.globalStores.key_comp(), data.globalStores.get_allocator());
+	for (ValueSet::iterator it = data.globalStores.begin(),
+					ie = data.globalStores.end();
+			it != ie; it++) {
+		llvm::Value * object = llvm::GetUnderlyingObject(
+				const_cast<llvm::Value*>(it->value));
+		if (llvm::isa<llvm::GlobalValue>(object)) {
+			globalStores.insert(object);
+		} else {
+			data.unknownStores.insert(*it);
+		}
+	}
+	data.globalStores.swap(globalStores);
+	ValueSet argumentStores(data.argumentStores.key_comp(), data.argumentStores.get_allocator());
+	for (ValueSet::iterator it = data.argumentStores.begin(),
+					ie = data.argumentStores.end();
+			it != ie; it++) {
+		argumentStores.insert(llvm::isa<llvm::Argument>(*it) ?
+				it->value : getSummaryHandle(F));
+	}
+	data.argumentStores.swap(argumentStores);
+	if (!data.heapStores.empty()) {
+		data.heapStores.clear();
+		data.heapStores.insert(getSummaryHandle(F));
+	}
+	if (!data.unknownStores.empty()) {
+		data.unknownStores.clear();
+		data.unknownStores.insert(getSummaryHandle(F));
+	}
+	data.stackStores.clear();
+	data.temporaries.clear();
+	data.stores.clear();
+	data.functionCalls.clear();
+	data.indirectFunctionCalls.clear();
+}
+
+const llvm::Value * MemoryAccessInstVisitor::getSummaryHandle(const llvm::Function & F) {
+	return llvm::MDString::get(F.getContext(), F.getName());
+}
+
+// Callers only see the canonical summary. Drop what only the function's
+// own printout would show.
+void MemoryAccessInstVisitor::dropCallerInvisibleData() {
+	MemoryAccessData & data = *functionData;
+	data.stackStores.clear();
+	data.temporaries.clear();
+	data.stores.clear();
 }
 
 bool MemoryAccessInstVisitor::isSummariseFunction() const {
@@ -225,6 +395,13 @@ bool MemoryAccessInstVisitor::isSummariseFunction() const {
 	return true;
 }
 
+void MemoryAccessInstVisitor::visit(llvm::BasicBlock * bb, DeltaType & changed) {
+	MemoryAccessData & bbData = getData(bb);
+	size_t position = bbData.storesLog.size();
+	visit(*bb);
+	changed.insert(bbData.storesLog.begin() + position, bbData.storesLog.end());
+}
+
 void MemoryAccessInstVisitor::visitFunction(llvm::Function & function) {
 	assert((!this->function) && "MemoryAccessInstVisitor::visitFunction called more than once");
 	this->function = &function;
@@ -243,6 +420,10 @@ void MemoryAccessInstVisitor::visitStoreInst(llvm::StoreInst & si) {
 	MemoryAccessData & data = getData(basicBlock);
 	StoredValue storedPointer = data.m_evaluator.visit(pointer);
 	StoredValue storedValue = data.m_evaluator.visit(value);
+	if ((storedPointer.type == StoredValueTypeUnknown) && escapeAnalysis &&
+			escapeAnalysis->isLocal(pointer)) {
+		storedPointer = StoredValue(pointer, StoredValueTypeStack);
+	}
 	store(data, storedPointer, storedValue);
 }
 
@@ -252,7 +433,14 @@ void MemoryAccessInstVisitor::store(MemoryAccessData & data,
 		return;
 	}
 	const llvm::Value * epointer = pointer.value;
-	data.stores[epointer] = value;
+	StoreBaseToValueMap::iterator it = data.stores.find(epointer);
+	if (it == data.stores.end()) {
+		data.stores.insert(std::make_pair(epointer, value));
+		storeChanged(data, epointer);
+	} else if ((it->second != value) && !isWidened(data, epointer)) {
+		it->second = value;
+		storeChanged(data, epointer);
+	}
 	const StoredValueType pointerType = pointer.type;
 	if (pointerType == StoredValueTypeStack) {
 		data.stackStores.insert(epointer);
@@ -315,23 +503,82 @@ bool MemoryAccessInstVisitor::join(
 	return result;
 }
 
-template <class T>
-bool MemoryAccessInstVisitor::join(const std::set<const T *> & from,
-		std::set<const T *> & to) const {
+template <class SetType>
+bool MemoryAccessInstVisitor::join(const SetType & from, SetType & to) const {
 	bool result = !(std::includes(to.begin(), to.end(),
-			from.begin(), from.end()));
+			from.begin(), from.end(), to.key_comp()));
 	to.insert(from.begin(), from.end());
 	return result;
 }
 
-bool MemoryAccessInstVisitor::join(const MemoryAccessData & from, MemoryAccessData & to) const {
+bool MemoryAccessInstVisitor::joinStoredValue(MemoryAccessData & data,
+		const llvm::Value * epointer, const StoredValue &value) const {
+	if (!joinStoredValues(data.stores, epointer, value)) {
+		return false;
+	}
+	storeChanged(data, epointer);
+	return true;
+}
+
+void MemoryAccessInstVisitor::storeChanged(MemoryAccessData & data,
+		const llvm::Value * epointer) const {
+	if (MemoryAccessDeltaJoin) {
+		data.storesLog.push_back(epointer);
+	}
+	if (!MemoryAccessWideningThreshold) {
+		return;
+	}
+	unsigned & count = data.storesChangeCount[epointer];
+	if (++count == (unsigned)MemoryAccessWideningThreshold) {
+		data.stores[epointer] = StoredValue::top;
+	}
+}
+
+bool MemoryAccessInstVisitor::isWidened(const MemoryAccessData & data,
+		const llvm::Value * epointer) const {
+	if (!MemoryAccessWideningThreshold) {
+		return false;
+	}
+	std::map<const llvm::Value*, unsigned>::const_iterator it =
+			data.storesChangeCount.find(epointer);
+	return ((it != data.storesChangeCount.end()) &&
+			(it->second >= (unsigned)MemoryAccessWideningThreshold));
+}
+
+bool MemoryAccessInstVisitor::joinStores(const MemoryAccessData & from,
+		MemoryAccessData & to) const {
+	bool result = false;
+	for (StoreBaseToValueMap::const_iterator it = from.stores.begin(),
+							ie = from.stores.end();
+			it != ie; it++) {
+		result |= joinStoredValue(to, it->first, it->second);
+	}
+	return result;
+}
+
+// Only the entries of keys
+bool MemoryAccessInstVisitor::joinStores(const MemoryAccessData & from,
+		MemoryAccessData & to, const DeltaType & keys) const {
+	bool result = false;
+	for (DeltaType::const_iterator it = keys.begin(), ie = keys.end();
+			it != ie; it++) {
+		StoreBaseToValueMap::const_iterator vit = from.stores.find(*it);
+		if (vit != from.stores.end()) {
+			result |= joinStoredValue(to, *it, vit->second);
+		}
+	}
+	return result;
+}
+
+bool MemoryAccessInstVisitor::join(const MemoryAccessData & from, MemoryAccessData & to,
+		bool isJoinStores) const {
 	bool result = join(from.stackStores, to.stackStores) |
 			join(from.globalStores, to.globalStores) |
 			join(from.argumentStores, to.argumentStores) |
 			join(from.heapStores, to.heapStores) |
 			join(from.unknownStores, to.unknownStores) |
 			join(from.temporaries, to.temporaries) |
-			join(from.stores, to.stores) |
+			(isJoinStores && joinStores(from, to)) |
 			join(from.functionCalls, to.functionCalls) |
 			join(from.indirectFunctionCalls, to.indirectFunctionCalls);
 	return result;
@@ -347,12 +594,60 @@ bool MemoryAccessInstVisitor::join(const llvm::BasicBlock * from, const llvm::Ba
 		result = true;
 	}
 	MemoryAccessData & toData = getData(to);
-	return join(fromData, toData) || result;
+	if (!MemoryAccessDeltaJoin) {
+		return join(fromData, toData) || result;
+	}
+	std::pair<const MemoryAccessData*, const MemoryAccessData*> edge(&fromData, &toData);
+	bool isJoined = (edgeCursors.find(edge) != edgeCursors.end());
+	std::pair<size_t, size_t> & cursor = edgeCursors[edge];
+	result |= join(fromData, toData, false);
+	if (!isJoined) {
+		result |= joinStores(fromData, toData);
+	} else {
+		DeltaType keys(fromData.storesLog.begin() + cursor.first,
+				fromData.storesLog.end());
+		keys.insert(toData.storesLog.begin() + cursor.second,
+				toData.storesLog.end());
+		result |= joinStores(fromData, toData, keys);
+	}
+	cursor.first = fromData.storesLog.size();
+	cursor.second = toData.storesLog.size();
+	return result;
+}
+
+// changed replaces the cursor into the source's storesLog
+bool MemoryAccessInstVisitor::join(const llvm::BasicBlock * from, const llvm::BasicBlock * to,
+		const DeltaType & changed, DeltaType & toChanged) {
+	if (haveIHadEnough) {
+		return false;
+	}
+	bool result = false;
+	MemoryAccessData & fromData = getData(from);
+	if (data.find(to) == data.end()) {
+		result = true;
+	}
+	MemoryAccessData & toData = getData(to);
+	size_t position = toData.storesLog.size();
+	std::pair<const MemoryAccessData*, const MemoryAccessData*> edge(&fromData, &toData);
+	bool isJoined = (edgeCursors.find(edge) != edgeCursors.end());
+	std::pair<size_t, size_t> & cursor = edgeCursors[edge];
+	result |= join(fromData, toData, false);
+	if (!isJoined) {
+		result |= joinStores(fromData, toData);
+	} else {
+		DeltaType keys(changed);
+		keys.insert(toData.storesLog.begin() + cursor.second,
+				toData.storesLog.begin() + position);
+		result |= joinStores(fromData, toData, keys);
+	}
+	cursor.second = toData.storesLog.size();
+	toChanged.insert(toData.storesLog.begin() + position, toData.storesLog.end());
+	return result;
 }
 
 void MemoryAccessInstVisitor::join(MemoryAccessCache * cache) {
 	assert((!functionData) && "MemoryAccessInstVisitor::join called more than once");
-	functionData = new MemoryAccessData();
+	functionData = new MemoryAccessData(0, numbering);
 	if (!function->empty()) {
 		const MemoryAccessData &bb_data = getData(&function->back());
 		join(bb_data, *functionData);
@@ -362,16 +657,81 @@ void MemoryAccessInstVisitor::join(MemoryAccessCache * cache) {
 	}
 	// Now join over function calls
 	// TODO(oanson) Handle recursive calls
-	for (std::set<const llvm::CallInst *>::iterator it = functionData->functionCalls.begin(),
+	// Calls with the same callee summary and the same arguments it
+	// writes through add nothing new
+	std::set<std::pair<const CanonicalSummary *, std::vector<const llvm::Value *> > > joined;
+	for (CallInstSet::iterator it = functionData->functionCalls.begin(),
 						ie = functionData->functionCalls.end();
 			it != ie; it++) {
 		const llvm::CallInst * ci = *it;
+		llvm::Function * F = ci->getCalledFunction();
+		if (isPredefinedFunction(*F)) {
+			joinCall(*ci, cache);
+			continue;
+		}
+		const CanonicalSummary * summary = cache->getVisitor(F)->canonicalSummary;
+		if (summary && !summary->isModifiesUnknown) {
+			std::vector<const llvm::Value *> operands;
+			for (std::vector<unsigned>::const_iterator ait = summary->arguments.begin(),
+									aie = summary->arguments.end();
+					ait != aie; ait++) {
+				operands.push_back(ci->getArgOperand(*ait));
+			}
+			if (!joined.insert(std::make_pair(summary, operands)).second) {
+				cache->addCaller(F, function);
+				continue;
+			}
+		}
 		joinCall(*ci, cache);
 	}
+	// Indirect calls with known callees are joined over all of them
+	std::vector<const llvm::CallInst *> resolved;
+	for (CallInstSet::iterator it = functionData->indirectFunctionCalls.begin(),
+						ie = functionData->indirectFunctionCalls.end();
+			it != ie; it++) {
+		const llvm::CallInst * ci = *it;
+		std::vector<llvm::Function *> callees;
+		if (!cache->getIndirectCallees(*ci, callees)) {
+			continue;
+		}
+		bool isComputed = true;
+		for (std::vector<llvm::Function *>::iterator fit = callees.begin(),
+							fie = callees.end();
+				fit != fie; fit++) {
+			if (!isPredefinedFunction(**fit) &&
+					!cache->getVisitor(*fit)->canonicalSummary) {
+				// Recursion through the indirect call
+				isComputed = false;
+				break;
+			}
+		}
+		if (!isComputed) {
+			continue;
+		}
+		for (std::vector<llvm::Function *>::iterator fit = callees.begin(),
+							fie = callees.end();
+				fit != fie; fit++) {
+			joinCall(*ci, *fit, cache);
+		}
+		indirectCallees.insert(indirectCallees.end(), callees.begin(), callees.end());
+		resolved.push_back(ci);
+	}
+	for (std::vector<const llvm::CallInst *>::iterator it = resolved.begin(),
+							ie = resolved.end();
+			it != ie; it++) {
+		functionData->indirectFunctionCalls.erase(*it);
+	}
+	std::sort(indirectCallees.begin(), indirectCallees.end());
+	indirectCallees.erase(std::unique(indirectCallees.begin(), indirectCallees.end()),
+			indirectCallees.end());
 }
 
 bool MemoryAccessInstVisitor::joinCall(const llvm::CallInst & ci, MemoryAccessCache * cache) {
-	llvm::Function * F = ci.getCalledFunction();
+	return joinCall(ci, ci.getCalledFunction(), cache);
+}
+
+bool MemoryAccessInstVisitor::joinCall(const llvm::CallInst & ci, llvm::Function * F,
+		MemoryAccessCache * cache) {
 	if (isPredefinedFunction(*F)) {
 		if (isSummariseFunctionCache != Tristate_False) {
 			isSummariseFunctionCache = Tristate_False;
@@ -380,44 +740,51 @@ bool MemoryAccessInstVisitor::joinCall(const llvm::CallInst & ci, MemoryAccessCa
 		return false;
 	}
 	const MemoryAccessInstVisitor * visitor = cache->getVisitor(F);
-	// Cache already returns visitor after call to join, so no need
-	// for nested treatment
-	const MemoryAccessData & calleeData = *(visitor->functionData);
+	cache->addCaller(F, function);
+	const CanonicalSummary * summary = visitor->canonicalSummary;
+	// Recursive call: The callee is still being computed further up the
+	// stack. Use what it has so far.
+	CanonicalSummary inProgress;
+	if (!summary) {
+		if (visitor->functionData) {
+			inProgress.build(*visitor->functionData);
+		} else {
+			inProgress.isModifiesUnknown = true;
+		}
+		summary = &inProgress;
+	}
 	MemoryAccessData & data = *functionData;
 	bool result = false;
-	result |= join(calleeData.globalStores, data.globalStores);
-	result |= join(calleeData.heapStores, data.unknownStores);
-	result |= join(calleeData.unknownStores, data.unknownStores);
-	result |= joinCalleeArguments(ci, visitor);
-	if ((isSummariseFunctionCache != Tristate_False) && (!visitor->isSummariseFunction())) {
+	for (std::vector<const llvm::GlobalValue *>::const_iterator it = summary->globals.begin(),
+								ie = summary->globals.end();
+			it != ie; it++) {
+		result |= data.globalStores.insert(*it).second;
+	}
+	if (summary->isModifiesUnknown) {
+		// The callee's handle stands in for whatever it writes
+		result |= data.unknownStores.insert(getSummaryHandle(*F)).second;
+	}
+	result |= joinCalleeArguments(ci, *summary);
+	if ((isSummariseFunctionCache != Tristate_False) && (!summary->isSummarise)) {
 		isSummariseFunctionCache = Tristate_False;
 	}
 	return result;
 }
 
 bool MemoryAccessInstVisitor::joinCalleeArguments(const llvm::CallInst & ci,
-		const MemoryAccessInstVisitor * visitor) {
-	const MemoryAccessData & calleeData = *(visitor->functionData);
+		const CanonicalSummary & summary) {
 	MemoryAccessData & data = *functionData;
 	// TODO(oanson) result value may be calculated wrongly.
 	bool result = false;
-	for (ValueSet::const_iterator it = calleeData.argumentStores.begin(),
-						ie = calleeData.argumentStores.end();
+	for (std::vector<unsigned>::const_iterator it = summary.arguments.begin(),
+							ie = summary.arguments.end();
 			it != ie; it++) {
-		const llvm::Value * argumentValue = *it;
-		const llvm::Argument * argument = llvm::dyn_cast<llvm::Argument>(argumentValue);
-		if (!argument) {
-			//llvm::errs() << "Store to inner argument, but not an argument: " << *argumentValue << "\n";
-			data.unknownStores.insert(argumentValue);
-			result = true;
-			continue;
-		}
-		unsigned index = argument->getArgNo();
+		unsigned index = *it;
 		llvm::Value * parameter = ci.getArgOperand(index);
 		StoredValue value = data.m_evaluator.visit(parameter);
 		if (value.isTop()) {
 			//llvm::errs() << "Store to inner argument, but operand is top: " << *parameter << "\n";
-			data.unknownStores.insert(argumentValue);
+			data.unknownStores.insert(ci.getCalledValue());
 			result = true;
 			continue;
 		}
@@ -430,15 +797,45 @@ bool MemoryAccessInstVisitor::joinCalleeArguments(const llvm::CallInst & ci,
 }
 
 MemoryAccessData & MemoryAccessInstVisitor::getData(const llvm::BasicBlock * bb) {
+	std::map<const llvm::BasicBlock*, const llvm::BasicBlock*>::iterator oit =
+			dataOwners.find(bb);
+	if (oit != dataOwners.end()) {
+		bb = oit->second;
+	}
 	// Optimisation: Use lower_bound as hint
 	std::map<const llvm::BasicBlock*, MemoryAccessData*>::iterator it =
 			data.find(bb);
 	if (it != data.end()) {
 		return *(it->second);
 	}
-	MemoryAccessData * presult = new MemoryAccessData();
+	void * memory = arena.Allocate(sizeof(MemoryAccessData),
+			llvm::AlignOf<MemoryAccessData>::Alignment);
+	MemoryAccessData * presult = new (memory) MemoryAccessData(&arena, numbering);
 	data[bb] = presult;
 	return *presult;
 }
 
+void MemoryAccessInstVisitor::setDataOwner(const llvm::BasicBlock * bb,
+		const llvm::BasicBlock * owner) {
+	if (bb == owner) {
+		dataOwners.erase(bb);
+	} else {
+		dataOwners[bb] = owner;
+	}
+}
+
+bool MemoryAccessInstVisitor::hasMemoryEffects(const llvm::BasicBlock & bb) const {
+	for (llvm::BasicBlock::const_iterator it = bb.begin(), ie = bb.end();
+			it != ie; it++) {
+		if (llvm::isa<llvm::StoreInst>(it)) {
+			return true;
+		}
+		if (llvm::isa<llvm::CallInst>(it) &&
+				!llvm::isa<llvm::DbgInfoIntrinsic>(it)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 }
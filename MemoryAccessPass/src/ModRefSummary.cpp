@@ -0,0 +1,87 @@
+#include <algorithm>
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Argument.h>
+
+#include <ModRefSummary.h>
+#include <MemoryAccessInstVisitor.h>
+
+namespace MemoryAccessPass {
+
+PointerBloomFilter::PointerBloomFilter() {
+	std::fill(m_words, m_words + (Bits / 64), 0);
+}
+
+void PointerBloomFilter::hash(const void * pointer, unsigned & h1, unsigned & h2) {
+	// Low bits of a pointer are mostly alignment. Mix the rest.
+	uint64_t key = reinterpret_cast<uintptr_t>(pointer) >> 3;
+	key *= 0x9E3779B97F4A7C15ULL;
+	h1 = (unsigned)(key >> 32) % Bits;
+	h2 = (unsigned)(key >> 8) % Bits;
+}
+
+void PointerBloomFilter::insert(const void * pointer) {
+	unsigned h1, h2;
+	hash(pointer, h1, h2);
+	m_words[h1 / 64] |= (1ULL << (h1 % 64));
+	m_words[h2 / 64] |= (1ULL << (h2 % 64));
+}
+
+bool PointerBloomFilter::mayContain(const void * pointer) const {
+	unsigned h1, h2;
+	hash(pointer, h1, h2);
+	return (m_words[h1 / 64] & (1ULL << (h1 % 64))) &&
+			(m_words[h2 / 64] & (1ULL << (h2 % 64)));
+}
+
+ModRefSummary::ModRefSummary() : m_isModifiesAnything(false) {}
+
+void ModRefSummary::build(const MemoryAccessData & data) {
+	if (!data.unknownStores.empty() || !data.heapStores.empty() ||
+			!data.indirectFunctionCalls.empty()) {
+		m_isModifiesAnything = true;
+	}
+	for (ValueSet::const_iterator it = data.globalStores.begin(),
+					ie = data.globalStores.end();
+			it != ie; it++) {
+		llvm::Value * pointer = const_cast<llvm::Value *>(it->value);
+		llvm::Value * object = llvm::GetUnderlyingObject(pointer);
+		if (!llvm::isa<llvm::GlobalValue>(object)) {
+			m_isModifiesAnything = true;
+			continue;
+		}
+		m_globals.push_back(object);
+		m_globalsFilter.insert(object);
+	}
+	std::sort(m_globals.begin(), m_globals.end());
+	m_globals.erase(std::unique(m_globals.begin(), m_globals.end()),
+			m_globals.end());
+	for (ValueSet::const_iterator it = data.argumentStores.begin(),
+					ie = data.argumentStores.end();
+			it != ie; it++) {
+		llvm::Value * pointer = const_cast<llvm::Value *>(it->value);
+		llvm::Value * object = llvm::GetUnderlyingObject(pointer);
+		const llvm::Argument * argument = llvm::dyn_cast<llvm::Argument>(object);
+		if (!argument) {
+			m_isModifiesAnything = true;
+			continue;
+		}
+		m_arguments.push_back(argument->getArgNo());
+	}
+	std::sort(m_arguments.begin(), m_arguments.end());
+	m_arguments.erase(std::unique(m_arguments.begin(), m_arguments.end()),
+			m_arguments.end());
+}
+
+bool ModRefSummary::mayModifyGlobal(const llvm::GlobalValue * global) const {
+	if (m_isModifiesAnything) {
+		return true;
+	}
+	if (!m_globalsFilter.mayContain(global)) {
+		return false;
+	}
+	const llvm::Value * value = global;
+	return std::binary_search(m_globals.begin(), m_globals.end(), value);
+}
+
+}
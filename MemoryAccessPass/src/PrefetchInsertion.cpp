@@ -0,0 +1,244 @@
+#include <vector>
+
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <PrefetchInsertion.h>
+
+#define REBUILD_DEPTH_WATERMARK 8
+
+namespace MemoryAccessPass {
+
+// Iterations ahead to prefetch
+int MemoryAccessPrefetchDistance = 16;
+// Smaller strides are left to the hardware prefetcher
+int MemoryAccessPrefetchMinStride = 256;
+
+typedef enum {
+	Rebuild_Fails,
+	Rebuild_Unchanged,
+	Rebuild_Changed
+} RebuildResult;
+
+// What rebuild would return, without inserting anything
+static RebuildResult checkRebuild(llvm::Value * value, llvm::Value * from,
+		unsigned depth) {
+	if (value == from) {
+		return Rebuild_Changed;
+	}
+	llvm::Instruction * I = llvm::dyn_cast<llvm::Instruction>(value);
+	if (!I || (!llvm::isa<llvm::GetElementPtrInst>(I) &&
+			!llvm::isa<llvm::CastInst>(I) && !llvm::isa<llvm::BinaryOperator>(I))) {
+		return Rebuild_Unchanged;
+	}
+	if (depth >= REBUILD_DEPTH_WATERMARK) {
+		return Rebuild_Fails;
+	}
+	RebuildResult result = Rebuild_Unchanged;
+	for (unsigned idx = 0; idx < I->getNumOperands(); idx++) {
+		RebuildResult operand = checkRebuild(I->getOperand(idx), from, depth + 1);
+		if (operand == Rebuild_Fails) {
+			return Rebuild_Fails;
+		}
+		if (operand == Rebuild_Changed) {
+			result = Rebuild_Changed;
+		}
+	}
+	return result;
+}
+
+// Rebuilds value's computation, with from replaced by to. Returns value if
+// it doesn't depend on from, and 0 if it can't be rebuilt.
+static llvm::Value * rebuild(llvm::Value * value, llvm::Value * from,
+		llvm::Value * to, llvm::IRBuilder<> & builder, unsigned depth) {
+	if (value == from) {
+		return to;
+	}
+	llvm::Instruction * I = llvm::dyn_cast<llvm::Instruction>(value);
+	if (!I || (!llvm::isa<llvm::GetElementPtrInst>(I) &&
+			!llvm::isa<llvm::CastInst>(I) && !llvm::isa<llvm::BinaryOperator>(I))) {
+		return value;
+	}
+	if (depth >= REBUILD_DEPTH_WATERMARK) {
+		return 0;
+	}
+	std::vector<llvm::Value *> operands;
+	bool isChanged = false;
+	for (unsigned idx = 0; idx < I->getNumOperands(); idx++) {
+		llvm::Value * operand = rebuild(I->getOperand(idx), from, to, builder, depth + 1);
+		if (!operand) {
+			return 0;
+		}
+		isChanged |= (operand != I->getOperand(idx));
+		operands.push_back(operand);
+	}
+	if (!isChanged) {
+		return value;
+	}
+	llvm::Instruction * clone = I->clone();
+	for (unsigned idx = 0; idx < operands.size(); idx++) {
+		clone->setOperand(idx, operands[idx]);
+	}
+	return builder.Insert(clone);
+}
+
+void PrefetchInsertion::emitPrefetch(llvm::IRBuilder<> & builder,
+		llvm::Value * address, bool isWrite) {
+	llvm::Value * args[] = {
+		builder.CreatePointerCast(address, builder.getInt8PtrTy()),
+		builder.getInt32(isWrite ? 1 : 0),
+		// High temporal locality, data cache
+		builder.getInt32(3),
+		builder.getInt32(1)
+	};
+	builder.CreateCall(prefetch, args);
+	insertedCount++;
+}
+
+bool PrefetchInsertion::insertStrided(llvm::Instruction * access,
+		llvm::Value * pointer, llvm::ScalarEvolution & SE,
+		llvm::SCEVExpander & expander) {
+	const llvm::SCEVAddRecExpr * addRec =
+			llvm::cast<llvm::SCEVAddRecExpr>(SE.getSCEV(pointer));
+	const llvm::SCEV * ahead = SE.getMulExpr(addRec->getStepRecurrence(SE),
+			SE.getConstant(addRec->getStepRecurrence(SE)->getType(),
+					MemoryAccessPrefetchDistance));
+	const llvm::SCEV * future = SE.getAddExpr(addRec, ahead);
+	llvm::Value * address = expander.expandCodeFor(future, pointer->getType(), access);
+	llvm::IRBuilder<> builder(access);
+	emitPrefetch(builder, address, llvm::isa<llvm::StoreInst>(access));
+	return true;
+}
+
+bool PrefetchInsertion::insertGather(llvm::Instruction * access,
+		llvm::Value * pointer, const AccessPattern & pattern, llvm::Loop * L,
+		llvm::ScalarEvolution & SE, llvm::DominatorTree & DT,
+		llvm::SCEVExpander & expander) {
+	llvm::LoadInst * source = pattern.source;
+	// The index load reads up to the element of the last iteration. Only
+	// safe if source reads it too: It runs on every iteration, and the
+	// loop only exits at the end of one.
+	llvm::BasicBlock * latch = L->getLoopLatch();
+	if (!latch || (L->getExitingBlock() != latch) ||
+			!DT.dominates(source->getParent(), latch)) {
+		return false;
+	}
+	const llvm::SCEVAddRecExpr * addRec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(
+			SE.getSCEV(source->getPointerOperand()));
+	if (!addRec || (addRec->getLoop() != L)) {
+		return false;
+	}
+	const llvm::SCEVConstant * step = llvm::dyn_cast<llvm::SCEVConstant>(
+			addRec->getStepRecurrence(SE));
+	const llvm::SCEV * backedgeTakenCount = SE.getBackedgeTakenCount(L);
+	if (!step || step->getValue()->isZero() ||
+			llvm::isa<llvm::SCEVCouldNotCompute>(backedgeTakenCount)) {
+		return false;
+	}
+	if (checkRebuild(pointer, source, 0) != Rebuild_Changed) {
+		return false;
+	}
+	// The index load must not read past the last element the loop reads
+	const llvm::SCEV * future = SE.getAddExpr(addRec, SE.getMulExpr(step,
+			SE.getConstant(step->getType(), MemoryAccessPrefetchDistance)));
+	const llvm::SCEV * last = addRec->evaluateAtIteration(backedgeTakenCount, SE);
+	const llvm::SCEV * clamped = step->getValue()->isNegative() ?
+			SE.getUMaxExpr(future, last) : SE.getUMinExpr(future, last);
+	llvm::Value * indexPointer = expander.expandCodeFor(clamped,
+			source->getPointerOperand()->getType(), access);
+	llvm::IRBuilder<> builder(access);
+	llvm::Value * index = builder.CreateLoad(indexPointer);
+	llvm::Value * address = rebuild(pointer, source, index, builder, 0);
+	emitPrefetch(builder, address, llvm::isa<llvm::StoreInst>(access));
+	return true;
+}
+
+// For p = p->next, prefetches p->next as soon as it is loaded, one
+// iteration ahead of its use. Going further ahead would need a load
+// through p->next, which may fault, so it is not done.
+bool PrefetchInsertion::insertChase(llvm::LoadInst * source, llvm::Loop * L,
+		std::set<llvm::LoadInst *> & chased) {
+	if (!source->getType()->isPointerTy() || !chased.insert(source).second) {
+		return false;
+	}
+	llvm::BasicBlock * latch = L->getLoopLatch();
+	if (!latch) {
+		return false;
+	}
+	// The node source is loaded from
+	llvm::PHINode * node = 0;
+	for (llvm::BasicBlock::iterator it = L->getHeader()->begin();
+			llvm::isa<llvm::PHINode>(it); it++) {
+		llvm::PHINode * phi = llvm::cast<llvm::PHINode>(it);
+		if (phi->getIncomingValueForBlock(latch) == source) {
+			node = phi;
+			break;
+		}
+	}
+	if (!node || (checkRebuild(source->getPointerOperand(), node, 0) != Rebuild_Changed)) {
+		return false;
+	}
+	llvm::BasicBlock::iterator next = source;
+	next++;
+	llvm::IRBuilder<> builder(source->getParent(), next);
+	emitPrefetch(builder, source, false);
+	return true;
+}
+
+bool PrefetchInsertion::runOnFunction(llvm::Function &F) {
+	AccessPatternAnalysis & patterns = getAnalysis<AccessPatternAnalysis>();
+	llvm::LoopInfo & LI = getAnalysis<llvm::LoopInfo>();
+	llvm::ScalarEvolution & SE = getAnalysis<llvm::ScalarEvolution>();
+	llvm::DominatorTree & DT = getAnalysis<llvm::DominatorTree>();
+	prefetch = llvm::Intrinsic::getDeclaration(F.getParent(), llvm::Intrinsic::prefetch);
+	// Copied: Inserting invalidates the analysis
+	std::vector<std::pair<llvm::Instruction *, AccessPattern> > accesses;
+	for (std::map<const llvm::Instruction *, AccessPattern>::const_iterator it = patterns.getPatterns().begin(),
+										ie = patterns.getPatterns().end();
+			it != ie; it++) {
+		accesses.push_back(std::make_pair(
+				const_cast<llvm::Instruction *>(it->first), it->second));
+	}
+	llvm::SCEVExpander expander(SE, "prefetch");
+	std::set<llvm::LoadInst *> chased;
+	bool result = false;
+	for (unsigned idx = 0; idx < accesses.size(); idx++) {
+		llvm::Instruction * access = accesses[idx].first;
+		const AccessPattern & pattern = accesses[idx].second;
+		llvm::Value * pointer = llvm::isa<llvm::LoadInst>(access) ?
+				llvm::cast<llvm::LoadInst>(access)->getPointerOperand() :
+				llvm::cast<llvm::StoreInst>(access)->getPointerOperand();
+		llvm::Loop * L = LI.getLoopFor(access->getParent());
+		int64_t stride = (pattern.stride < 0) ? -pattern.stride : pattern.stride;
+		if ((pattern.type == AccessPattern_Strided) &&
+				(stride >= MemoryAccessPrefetchMinStride)) {
+			result |= insertStrided(access, pointer, SE, expander);
+		} else if ((pattern.type == AccessPattern_Indirect) && pattern.isPointerChase) {
+			result |= insertChase(pattern.source, L, chased);
+		} else if (pattern.type == AccessPattern_Indirect) {
+			result |= insertGather(access, pointer, pattern, L, SE, DT, expander);
+		}
+	}
+	return result;
+}
+
+void PrefetchInsertion::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+	AU.addRequired<AccessPatternAnalysis>();
+	AU.addRequired<llvm::LoopInfo>();
+	AU.addRequired<llvm::ScalarEvolution>();
+	AU.addRequired<llvm::DominatorTree>();
+	AU.setPreservesCFG();
+}
+
+void PrefetchInsertion::print(llvm::raw_ostream &O, const llvm::Module *M) const {
+	O << "Inserted " << insertedCount << " prefetches\n";
+}
+
+char PrefetchInsertion::ID = 0;
+static llvm::RegisterPass<PrefetchInsertion> _X(
+		"memprefetch",
+		"Insert software prefetches for strided and indirect loop accesses",
+		false, false);
+}
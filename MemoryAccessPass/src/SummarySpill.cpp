@@ -0,0 +1,153 @@
+#include <llvm/Support/DataTypes.h>
+
+#include <SummarySpill.h>
+
+namespace MemoryAccessPass {
+
+// Red-black tree node: colour, parent, left, right, then the element
+static const size_t TreeNodeOverhead = 4 * sizeof(void*);
+
+size_t estimateMemoryUsage(const MemoryAccessData & data) {
+	size_t setElements = data.stackStores.size() + data.globalStores.size() +
+			data.argumentStores.size() + data.heapStores.size() +
+			data.unknownStores.size() + data.functionCalls.size() +
+			data.indirectFunctionCalls.size();
+	size_t mapElements = data.temporaries.size() + data.stores.size();
+	return sizeof(MemoryAccessData) +
+			setElements * (TreeNodeOverhead + sizeof(void*)) +
+			mapElements * (TreeNodeOverhead + sizeof(FlatSummary::Entry)) +
+			data.storesLog.capacity() * sizeof(void*);
+}
+
+size_t estimateMemoryUsage(const FlatSummary & summary) {
+	size_t pointers = summary.functionCalls.capacity() +
+			summary.indirectFunctionCalls.capacity();
+	for (int idx = 0; idx < FlatSummary::SetCount; idx++) {
+		pointers += summary.sets[idx].capacity();
+	}
+	size_t entries = summary.temporaries.capacity() + summary.stores.capacity();
+	return sizeof(FlatSummary) + pointers * sizeof(void*) +
+			entries * sizeof(FlatSummary::Entry);
+}
+
+template <class SetType, class T>
+static void flattenSet(const SetType & from, std::vector<T> & to) {
+	to.assign(from.begin(), from.end());
+}
+
+template <class MapType>
+static void flattenMap(const MapType & from, std::vector<FlatSummary::Entry> & to) {
+	to.assign(from.begin(), from.end());
+}
+
+void FlatSummary::flatten(const MemoryAccessData & data) {
+	flattenSet(data.stackStores, sets[StackStores]);
+	flattenSet(data.globalStores, sets[GlobalStores]);
+	flattenSet(data.argumentStores, sets[ArgumentStores]);
+	flattenSet(data.heapStores, sets[HeapStores]);
+	flattenSet(data.unknownStores, sets[UnknownStores]);
+	flattenMap(data.temporaries, temporaries);
+	flattenMap(data.stores, stores);
+	flattenSet(data.functionCalls, functionCalls);
+	flattenSet(data.indirectFunctionCalls, indirectFunctionCalls);
+}
+
+void FlatSummary::inflate(MemoryAccessData & data) const {
+	// Vectors are sorted in the sets' order. Insertion with end() as
+	// hint is amortised constant.
+	data.stackStores.insert(sets[StackStores].begin(), sets[StackStores].end());
+	data.globalStores.insert(sets[GlobalStores].begin(), sets[GlobalStores].end());
+	data.argumentStores.insert(sets[ArgumentStores].begin(), sets[ArgumentStores].end());
+	data.heapStores.insert(sets[HeapStores].begin(), sets[HeapStores].end());
+	data.unknownStores.insert(sets[UnknownStores].begin(), sets[UnknownStores].end());
+	data.temporaries.insert(temporaries.begin(), temporaries.end());
+	data.stores.insert(stores.begin(), stores.end());
+	data.functionCalls.insert(functionCalls.begin(), functionCalls.end());
+	data.indirectFunctionCalls.insert(indirectFunctionCalls.begin(),
+			indirectFunctionCalls.end());
+}
+
+template <class T>
+static bool writeVector(FILE * file, const std::vector<T> & vector) {
+	uint64_t size = vector.size();
+	if (fwrite(&size, sizeof(size), 1, file) != 1) {
+		return false;
+	}
+	if (size == 0) {
+		return true;
+	}
+	return (fwrite(&vector[0], sizeof(T), size, file) == size);
+}
+
+template <class T>
+static bool readVector(FILE * file, std::vector<T> & vector) {
+	uint64_t size;
+	if (fread(&size, sizeof(size), 1, file) != 1) {
+		return false;
+	}
+	vector.resize(size);
+	if (size == 0) {
+		return true;
+	}
+	return (fread(&vector[0], sizeof(T), size, file) == size);
+}
+
+bool FlatSummary::write(FILE * file) const {
+	for (int idx = 0; idx < SetCount; idx++) {
+		if (!writeVector(file, sets[idx])) {
+			return false;
+		}
+	}
+	return writeVector(file, temporaries) &&
+			writeVector(file, stores) &&
+			writeVector(file, functionCalls) &&
+			writeVector(file, indirectFunctionCalls);
+}
+
+bool FlatSummary::read(FILE * file) {
+	for (int idx = 0; idx < SetCount; idx++) {
+		if (!readVector(file, sets[idx])) {
+			return false;
+		}
+	}
+	return readVector(file, temporaries) &&
+			readVector(file, stores) &&
+			readVector(file, functionCalls) &&
+			readVector(file, indirectFunctionCalls);
+}
+
+SummarySpillFile::SummarySpillFile(const char * path) {
+	m_file = path ? fopen(path, "w+b") : tmpfile();
+}
+
+SummarySpillFile::~SummarySpillFile() {
+	if (m_file) {
+		fclose(m_file);
+	}
+}
+
+long SummarySpillFile::write(const FlatSummary & summary) {
+	if (!m_file) {
+		return -1;
+	}
+	if (fseek(m_file, 0, SEEK_END) != 0) {
+		return -1;
+	}
+	long offset = ftell(m_file);
+	if (!summary.write(m_file)) {
+		return -1;
+	}
+	return offset;
+}
+
+bool SummarySpillFile::read(long offset, FlatSummary & summary) {
+	if (!m_file) {
+		return false;
+	}
+	if (fseek(m_file, offset, SEEK_SET) != 0) {
+		return false;
+	}
+	return summary.read(m_file);
+}
+
+}
@@ -0,0 +1,101 @@
+#include <llvm/IR/Argument.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/Support/InstIterator.h>
+
+#include <ValueNumbering.h>
+
+namespace MemoryAccessPass {
+
+ValueNumbering::ValueNumbering() : m_nextOther(1) {}
+
+void ValueNumbering::numberModule(const llvm::Module & M) {
+	uint64_t index = 1;
+	for (llvm::Module::const_iterator it = M.begin(), ie = M.end();
+			it != ie; it++) {
+		m_numbers.insert(std::make_pair(&*it, (index++) << 32));
+	}
+	for (llvm::Module::const_global_iterator it = M.global_begin(),
+							ie = M.global_end();
+			it != ie; it++) {
+		m_numbers.insert(std::make_pair(&*it, (index++) << 32));
+	}
+	for (llvm::Module::const_alias_iterator it = M.alias_begin(),
+							ie = M.alias_end();
+			it != ie; it++) {
+		m_numbers.insert(std::make_pair(&*it, (index++) << 32));
+	}
+}
+
+void ValueNumbering::numberFunction(const llvm::Function & F) {
+	if (m_locals.count(&F)) {
+		return;
+	}
+	std::vector<const llvm::Value *> & locals = m_locals[&F];
+	uint64_t number = getNumber(&F);
+	for (llvm::Function::const_arg_iterator it = F.arg_begin(), ie = F.arg_end();
+			it != ie; it++) {
+		locals.push_back(&*it);
+	}
+	for (llvm::const_inst_iterator it = llvm::inst_begin(F), ie = llvm::inst_end(F);
+			it != ie; it++) {
+		locals.push_back(&*it);
+	}
+	for (std::vector<const llvm::Value *>::iterator it = locals.begin(),
+							ie = locals.end();
+			it != ie; it++) {
+		// Entries already there keep their number, so that no value
+		// changes place in a container
+		m_numbers.insert(std::make_pair(*it, ++number));
+	}
+}
+
+uint64_t ValueNumbering::getNumber(const llvm::Value * V) {
+	llvm::DenseMap<const llvm::Value *, uint64_t>::iterator it = m_numbers.find(V);
+	if (it != m_numbers.end()) {
+		return it->second;
+	}
+	const llvm::Function * F = 0;
+	if (const llvm::Instruction * I = llvm::dyn_cast<llvm::Instruction>(V)) {
+		if (I->getParent()) {
+			F = I->getParent()->getParent();
+		}
+	} else if (const llvm::Argument * A = llvm::dyn_cast<llvm::Argument>(V)) {
+		F = A->getParent();
+	} else if (const llvm::GlobalValue * G = llvm::dyn_cast<llvm::GlobalValue>(V)) {
+		if (G->getParent()) {
+			numberModule(*G->getParent());
+		}
+	}
+	if (F) {
+		numberFunction(*F);
+	}
+	it = m_numbers.find(V);
+	if (it != m_numbers.end()) {
+		return it->second;
+	}
+	uint64_t number = m_nextOther++;
+	m_numbers[V] = number;
+	return number;
+}
+
+void ValueNumbering::forget(const llvm::Function * F) {
+	std::map<const llvm::Function *, std::vector<const llvm::Value *> >::iterator it =
+			m_locals.find(F);
+	if (it == m_locals.end()) {
+		return;
+	}
+	for (std::vector<const llvm::Value *>::iterator vit = it->second.begin(),
+							vie = it->second.end();
+			vit != vie; vit++) {
+		m_numbers.erase(*vit);
+	}
+	m_locals.erase(it);
+}
+
+void ValueNumbering::clear() {
+	m_numbers.clear();
+	m_locals.clear();
+	m_nextOther = 1;
+}
+
+}
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <map>
+
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Instructions.h>
+
+#include <WorkingSet.h>
+
+namespace MemoryAccessPass {
+
+// Cache geometry the report compares against
+int MemoryAccessCacheLineBytes = 64;
+int MemoryAccessL1Bytes = 32 * 1024;
+int MemoryAccessL2Bytes = 256 * 1024;
+int MemoryAccessLLCBytes = 8 * 1024 * 1024;
+// Trip count of loops ScalarEvolution can't count
+int MemoryAccessDefaultTripCount = 100;
+
+static uint64_t saturatingMultiply(uint64_t a, uint64_t b) {
+	if ((a != 0) && (b > UINT64_MAX / a)) {
+		return UINT64_MAX;
+	}
+	return a * b;
+}
+
+static uint64_t saturatingAdd(uint64_t a, uint64_t b) {
+	return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+static uint64_t getLines(uint64_t bytes) {
+	uint64_t lineBytes = MemoryAccessCacheLineBytes;
+	return saturatingAdd(bytes, lineBytes - 1) / lineBytes;
+}
+
+void Footprint::add(const Footprint & other) {
+	bytes = saturatingAdd(bytes, other.bytes);
+	lines = saturatingAdd(lines, other.lines);
+}
+
+uint64_t WorkingSet::getTripCount(llvm::Loop * L, llvm::ScalarEvolution & SE) const {
+	llvm::BasicBlock * exiting = L->getExitingBlock();
+	unsigned result = exiting ? SE.getSmallConstantTripCount(L, exiting) : 0;
+	return result ? result : MemoryAccessDefaultTripCount;
+}
+
+Footprint WorkingSet::estimate(llvm::Value * pointer, uint64_t size,
+		llvm::Loop * L, llvm::ScalarEvolution & SE) const {
+	Footprint result;
+	result.bytes = size;
+	result.lines = getLines(size);
+	const llvm::SCEV * scev = SE.getSCEV(pointer);
+	// Innermost loop first. Nested recurrences peel off one loop at a time.
+	for (; L; L = L->getParentLoop()) {
+		uint64_t trips = getTripCount(L, SE);
+		bool isStrideKnown = false;
+		uint64_t stride = 0;
+		const llvm::SCEVAddRecExpr * addRec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(scev);
+		if (addRec && (addRec->getLoop() == L)) {
+			const llvm::SCEVConstant * step = llvm::dyn_cast<llvm::SCEVConstant>(
+					addRec->getStepRecurrence(SE));
+			if (step) {
+				int64_t value = step->getValue()->getSExtValue();
+				stride = (value < 0) ? -value : value;
+				isStrideKnown = true;
+			}
+			scev = addRec->getStart();
+		} else if (SE.isLoopInvariant(scev, L)) {
+			// Same location every iteration
+			continue;
+		}
+		if (!isStrideKnown) {
+			result.bytes = saturatingMultiply(result.bytes, trips);
+			result.lines = saturatingMultiply(result.lines, trips);
+			continue;
+		}
+		if (stride == 0) {
+			continue;
+		}
+		uint64_t span = saturatingAdd(saturatingMultiply(stride, trips - 1),
+				result.bytes);
+		if (stride >= result.bytes) {
+			result.bytes = saturatingMultiply(result.bytes, trips);
+		} else {
+			result.bytes = span;
+		}
+		if (stride >= (uint64_t)MemoryAccessCacheLineBytes) {
+			result.lines = saturatingMultiply(result.lines, trips);
+		} else {
+			result.lines = getLines(span);
+		}
+	}
+	return result;
+}
+
+void WorkingSet::runOnFunction(llvm::Function & F, FunctionWorkingSet & workingSet) {
+	llvm::LoopInfo & LI = getAnalysis<llvm::LoopInfo>(F);
+	llvm::ScalarEvolution & SE = getAnalysis<llvm::ScalarEvolution>(F);
+	llvm::DataLayout & DL = getAnalysis<llvm::DataLayout>();
+	StoreBaseToValueMap stores;
+	Evaluator evaluator(stores);
+	// Per (pointer, innermost loop): The largest access through it
+	std::map<std::pair<const llvm::SCEV *, llvm::Loop *>,
+			std::pair<Footprint, StoredValueType> > accesses;
+	for (llvm::Function::iterator bit = F.begin(), bie = F.end();
+			bit != bie; bit++) {
+		llvm::Loop * L = LI.getLoopFor(&*bit);
+		for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+				it != ie; it++) {
+			llvm::Value * pointer = 0;
+			llvm::Type * type = 0;
+			if (llvm::LoadInst * li = llvm::dyn_cast<llvm::LoadInst>(&*it)) {
+				pointer = li->getPointerOperand();
+				type = li->getType();
+			} else if (llvm::StoreInst * si = llvm::dyn_cast<llvm::StoreInst>(&*it)) {
+				pointer = si->getPointerOperand();
+				type = si->getValueOperand()->getType();
+			} else {
+				continue;
+			}
+			Footprint footprint = estimate(pointer, DL.getTypeStoreSize(type), L, SE);
+			std::pair<Footprint, StoredValueType> & access =
+					accesses[std::make_pair(SE.getSCEV(pointer), L)];
+			if (footprint.bytes > access.first.bytes) {
+				access.first = footprint;
+				access.second = evaluator.visit(pointer).type;
+			}
+		}
+	}
+	std::map<llvm::Loop *, unsigned> nests;
+	for (std::map<std::pair<const llvm::SCEV *, llvm::Loop *>,
+				std::pair<Footprint, StoredValueType> >::iterator it = accesses.begin(),
+										ie = accesses.end();
+			it != ie; it++) {
+		const Footprint & footprint = it->second.first;
+		workingSet.total.add(footprint);
+		workingSet.regionBytes[it->second.second] = saturatingAdd(
+				workingSet.regionBytes[it->second.second], footprint.bytes);
+		llvm::Loop * L = it->first.second;
+		if (!L) {
+			continue;
+		}
+		while (L->getParentLoop()) {
+			L = L->getParentLoop();
+		}
+		std::map<llvm::Loop *, unsigned>::iterator nit = nests.find(L);
+		if (nit == nests.end()) {
+			std::string name = L->getHeader()->getName().str();
+			if (name.empty()) {
+				llvm::raw_string_ostream stream(name);
+				stream << "#" << nests.size();
+				stream.flush();
+			}
+			nit = nests.insert(std::make_pair(L, workingSet.loopNests.size())).first;
+			workingSet.loopNests.push_back(std::make_pair(name, Footprint()));
+		}
+		workingSet.loopNests[nit->second].second.add(footprint);
+	}
+}
+
+bool WorkingSet::runOnModule(llvm::Module &M) {
+	workingSets.clear();
+	for (llvm::Module::iterator it = M.begin(), ie = M.end(); it != ie; it++) {
+		if (it->isDeclaration()) {
+			continue;
+		}
+		workingSets.push_back(FunctionWorkingSet());
+		workingSets.back().name = it->getName().str();
+		runOnFunction(*it, workingSets.back());
+	}
+	return false;
+}
+
+void WorkingSet::getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+	AU.setPreservesAll();
+	AU.addRequired<llvm::DataLayout>();
+	AU.addRequired<llvm::LoopInfo>();
+	AU.addRequired<llvm::ScalarEvolution>();
+}
+
+static bool isLarger(const FunctionWorkingSet * a, const FunctionWorkingSet * b) {
+	if (a->total.lines != b->total.lines) {
+		return a->total.lines > b->total.lines;
+	}
+	return a->name < b->name;
+}
+
+static const char * regionNames[] = {
+	"unknown", "primitive", "constant", "stack", "global", "heap", "argument"
+};
+
+void WorkingSet::print(llvm::raw_ostream &O, const llvm::Module *M) const {
+	std::vector<const FunctionWorkingSet *> ranked;
+	uint64_t lineBytes = MemoryAccessCacheLineBytes;
+	for (std::vector<FunctionWorkingSet>::const_iterator it = workingSets.begin(),
+								ie = workingSets.end();
+			it != ie; it++) {
+		if (saturatingMultiply(it->total.lines, lineBytes) > (uint64_t)MemoryAccessL1Bytes) {
+			ranked.push_back(&*it);
+		}
+	}
+	std::sort(ranked.begin(), ranked.end(), isLarger);
+	O << "Working sets over L1 (line " << MemoryAccessCacheLineBytes <<
+			", L1 " << MemoryAccessL1Bytes << ", L2 " << MemoryAccessL2Bytes <<
+			", LLC " << MemoryAccessLLCBytes << " bytes):\n";
+	for (unsigned idx = 0; idx < ranked.size(); idx++) {
+		const FunctionWorkingSet & workingSet = *ranked[idx];
+		uint64_t lineFootprint = saturatingMultiply(workingSet.total.lines, lineBytes);
+		const char * level = "L1";
+		if (lineFootprint > (uint64_t)MemoryAccessLLCBytes) {
+			level = "LLC";
+		} else if (lineFootprint > (uint64_t)MemoryAccessL2Bytes) {
+			level = "L2";
+		}
+		O << (idx + 1) << ". " << workingSet.name << ": " <<
+				workingSet.total.bytes << " bytes, " <<
+				workingSet.total.lines << " lines. Exceeds " << level << "\n";
+		O << "\t";
+		for (int type = 0; type <= StoredValueTypeArgument; type++) {
+			if (workingSet.regionBytes[type]) {
+				O << regionNames[type] << " " << workingSet.regionBytes[type] << " ";
+			}
+		}
+		O << "\n";
+		for (std::vector<std::pair<std::string, Footprint> >::const_iterator it = workingSet.loopNests.begin(),
+											ie = workingSet.loopNests.end();
+				it != ie; it++) {
+			O << "\tLoop " << it->first << ": " << it->second.bytes <<
+					" bytes, " << it->second.lines << " lines\n";
+		}
+	}
+}
+
+char WorkingSet::ID = 0;
+static llvm::RegisterPass<WorkingSet> _X(
+		"memworkingset",
+		"Estimate functions' working sets",
+		false, false);
+}
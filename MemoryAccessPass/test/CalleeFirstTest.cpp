@@ -0,0 +1,85 @@
+// Prints every function's summary asked for directly, and asked for after
+// all other functions, which may reach it as a callee first. Fails if the
+// printouts differ.
+// Usage: CalleeFirstTest <module>...
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <MemoryAccess.h>
+
+using namespace MemoryAccessPass;
+
+// Lines sorted: Constants are numbered in order of first use, which may
+// order them differently
+static std::vector<std::string> print(MemoryAccess & memoryAccess, llvm::Function & F) {
+	std::string printout;
+	llvm::raw_string_ostream O(printout);
+	memoryAccess.print(O, *memoryAccess.getVisitor(&F));
+	O.flush();
+	std::vector<std::string> result;
+	std::string::size_type start = 0;
+	std::string::size_type end;
+	while ((end = printout.find('\n', start)) != std::string::npos) {
+		result.push_back(printout.substr(start, end - start));
+		start = end + 1;
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+static bool check(llvm::Module & M, llvm::Function & F) {
+	MemoryAccess direct;
+	std::vector<std::string> expected = print(direct, F);
+	MemoryAccess calleeFirst;
+	for (llvm::Module::iterator it = M.begin(), ie = M.end(); it != ie; it++) {
+		if (!it->isDeclaration() && (&*it != &F)) {
+			calleeFirst.getVisitor(&*it);
+		}
+	}
+	std::vector<std::string> actual = print(calleeFirst, F);
+	if (expected == actual) {
+		return true;
+	}
+	llvm::errs() << "\tDirect:\n";
+	for (unsigned idx = 0; idx < expected.size(); idx++) {
+		llvm::errs() << "\t\t" << expected[idx] << "\n";
+	}
+	llvm::errs() << "\tCallee first:\n";
+	for (unsigned idx = 0; idx < actual.size(); idx++) {
+		llvm::errs() << "\t\t" << actual[idx] << "\n";
+	}
+	return false;
+}
+
+int main(int argc, char ** argv) {
+	llvm::LLVMContext context;
+	unsigned failures = 0;
+	for (int idx = 1; idx < argc; idx++) {
+		llvm::SMDiagnostic error;
+		llvm::OwningPtr<llvm::Module> module(llvm::ParseIRFile(argv[idx], error, context));
+		if (!module) {
+			error.print(argv[0], llvm::errs());
+			return 2;
+		}
+		for (llvm::Module::iterator it = module->begin(), ie = module->end();
+				it != ie; it++) {
+			if (it->isDeclaration()) {
+				continue;
+			}
+			if (!check(*module, *it)) {
+				llvm::errs() << "FAIL " << argv[idx] << ": " << it->getName() << "\n";
+				failures++;
+			}
+		}
+	}
+	return failures ? 1 : 0;
+}
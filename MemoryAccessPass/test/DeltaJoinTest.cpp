@@ -0,0 +1,98 @@
+// Runs the dense and the delta-driven fixpoints over every function of the
+// given modules, and fails if their summaries differ.
+// Usage: DeltaJoinTest <module>...
+
+#include <algorithm>
+#include <string>
+
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <MemoryAccessInstVisitor.h>
+
+using namespace MemoryAccessPass;
+
+static bool compare(const char * name, const ValueSet & dense, const ValueSet & delta) {
+	if ((dense.size() == delta.size()) &&
+			std::equal(dense.begin(), dense.end(), delta.begin())) {
+		return true;
+	}
+	llvm::errs() << "\t" << name << " differ: " << dense.size() <<
+			" dense, " << delta.size() << " delta\n";
+	return false;
+}
+
+static bool compare(const char * name, const StoreBaseToValueMap & dense,
+		const StoreBaseToValueMap & delta) {
+	bool result = (dense.size() == delta.size());
+	for (StoreBaseToValueMap::const_iterator it = dense.begin(), ie = dense.end();
+			it != ie; it++) {
+		StoreBaseToValueMap::const_iterator dit = delta.find(it->first);
+		if (dit == delta.end()) {
+			llvm::errs() << "\t" << name << ": Only dense has " << *it->first << "\n";
+			result = false;
+		} else if (dit->second != it->second) {
+			llvm::errs() << "\t" << name << ": " << *it->first << " is " <<
+					it->second << " dense, " << dit->second << " delta\n";
+			result = false;
+		}
+	}
+	if (!result && (dense.size() != delta.size())) {
+		llvm::errs() << "\t" << name << ": " << dense.size() << " dense, " <<
+				delta.size() << " delta\n";
+	}
+	return result;
+}
+
+static bool check(llvm::Function & F) {
+	MemoryAccessDeltaJoin = 0;
+	MemoryAccessInstVisitor dense;
+	dense.runOnFunction(F);
+	MemoryAccessDeltaJoin = 1;
+	MemoryAccessInstVisitor delta;
+	delta.runOnFunction(F);
+	const MemoryAccessData & denseData = *dense.functionData;
+	const MemoryAccessData & deltaData = *delta.functionData;
+	bool result = (dense.haveIHadEnough == delta.haveIHadEnough);
+	if (!result) {
+		llvm::errs() << "\tBudgets differ\n";
+	}
+	result &= compare("Stack stores", denseData.stackStores, deltaData.stackStores);
+	result &= compare("Global stores", denseData.globalStores, deltaData.globalStores);
+	result &= compare("Argument stores", denseData.argumentStores, deltaData.argumentStores);
+	result &= compare("Heap stores", denseData.heapStores, deltaData.heapStores);
+	result &= compare("Unknown stores", denseData.unknownStores, deltaData.unknownStores);
+	result &= compare("Temporaries", denseData.temporaries, deltaData.temporaries);
+	result &= compare("Stores", denseData.stores, deltaData.stores);
+	return result;
+}
+
+int main(int argc, char ** argv) {
+	llvm::LLVMContext context;
+	unsigned failures = 0;
+	// Enough blocks for the inputs' loops to reach their fixpoints
+	VisitBlockCountWatermark = 1000;
+	for (int idx = 1; idx < argc; idx++) {
+		llvm::SMDiagnostic error;
+		llvm::OwningPtr<llvm::Module> module(llvm::ParseIRFile(argv[idx], error, context));
+		if (!module) {
+			error.print(argv[0], llvm::errs());
+			return 2;
+		}
+		for (llvm::Module::iterator it = module->begin(), ie = module->end();
+				it != ie; it++) {
+			if (it->isDeclaration()) {
+				continue;
+			}
+			if (!check(*it)) {
+				llvm::errs() << "FAIL " << argv[idx] << ": " << it->getName() << "\n";
+				failures++;
+			}
+		}
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+; Inputs for CalleeFirstTest: Callees with stack, global and argument
+; stores, reached through their callers before they are asked for.
+
+@g = global i32 0
+@q = global i32* null
+
+define void @callee(i32* %a) {
+entry:
+  %local = alloca i32
+  store i32 1, i32* %local
+  store i32 2, i32* @g
+  store i32 3, i32* %a
+  store i32* %a, i32** @q
+  ret void
+}
+
+define void @caller() {
+entry:
+  %x = alloca i32
+  store i32 0, i32* %x
+  call void @callee(i32* %x)
+  call void @callee(i32* @g)
+  ret void
+}
+
+define void @outer() {
+entry:
+  call void @caller()
+  store i32 4, i32* @g
+  ret void
+}
@@ -0,0 +1,89 @@
+; Inputs for DeltaJoinTest: Loops and merges where a block overwrites
+; entries its predecessors keep joining in.
+
+@g = global i32 0
+@h = global i32 0
+@p = global i32* null
+
+; The header overwrites @g, the latch writes it back
+define void @overwrite_in_header(i32 %n) {
+entry:
+  store i32 1, i32* @g
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %next, %latch ]
+  store i32 2, i32* @g
+  %done = icmp eq i32 %i, %n
+  br i1 %done, label %exit, label %latch
+
+latch:
+  store i32 3, i32* @g
+  %next = add i32 %i, 1
+  br label %header
+
+exit:
+  ret void
+}
+
+; Both arms of a diamond in a loop write @g and @h
+define void @diamond_in_loop(i32 %n, i32* %a) {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %next, %merge ]
+  %odd = and i32 %i, 1
+  %isOdd = icmp ne i32 %odd, 0
+  br i1 %isOdd, label %left, label %right
+
+left:
+  store i32 1, i32* @g
+  store i32* %a, i32** @p
+  br label %merge
+
+right:
+  store i32 2, i32* @g
+  store i32 %i, i32* @h
+  br label %merge
+
+merge:
+  store i32 %i, i32* %a
+  %next = add i32 %i, 1
+  %done = icmp eq i32 %next, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret void
+}
+
+; An inner loop keeps overwriting what the outer loop joins
+define void @nested(i32 %n, i32* %a) {
+entry:
+  %local = alloca i32
+  store i32 0, i32* %local
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %inext, %outer.latch ]
+  store i32 %i, i32* %local
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %jnext, %inner ]
+  store i32 %j, i32* @g
+  store i32 1, i32* %local
+  %jnext = add i32 %j, 1
+  %jdone = icmp eq i32 %jnext, %n
+  br i1 %jdone, label %outer.latch, label %inner
+
+outer.latch:
+  store i32 2, i32* @h
+  %inext = add i32 %i, 1
+  %idone = icmp eq i32 %inext, %n
+  br i1 %idone, label %exit, label %outer
+
+exit:
+  store i32 3, i32* %a
+  ret void
+}
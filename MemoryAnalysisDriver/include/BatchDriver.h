@@ -0,0 +1,63 @@
+#ifndef BATCH_DRIVER_H
+#define BATCH_DRIVER_H
+
+#include <pthread.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace MemoryAnalysisDriver {
+
+	// Runs an analysis on M, writing the result to O. Returns 0 on success.
+	typedef int (*AnalyseModuleFunction)(llvm::Module & M, llvm::raw_ostream & O);
+
+	// Analyses a list of bitcode files. Parse threads read modules, each
+	// into its own LLVMContext, and hand them to analysis threads through
+	// a bounded queue. Results are buffered and written in input order.
+	class BatchDriver {
+	protected:
+		struct Job {
+			unsigned index;
+			llvm::LLVMContext * context;
+			llvm::Module * module;
+		};
+
+		AnalyseModuleFunction m_analyse;
+		const std::vector<std::string> & m_filenames;
+		bool m_isLazy;
+		unsigned m_queueDepth;
+
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_notEmpty;
+		pthread_cond_t m_notFull;
+		// Next file to parse
+		unsigned m_nextFile;
+		// Parse threads still running
+		unsigned m_activeParsers;
+		std::deque<Job> m_queue;
+		std::vector<std::string> m_results;
+		std::vector<bool> m_isFailed;
+
+		static void * parseThread(void * driver);
+		static void * analyseThread(void * driver);
+		void parse();
+		void analyse();
+		void push(const Job & job);
+		bool pop(Job & job);
+	public:
+		BatchDriver(AnalyseModuleFunction analyse,
+				const std::vector<std::string> & filenames,
+				bool isLazy, unsigned queueDepth);
+		~BatchDriver();
+		// Returns the number of modules that failed to parse or analyse
+		unsigned run(unsigned parseThreads, unsigned analyseThreads);
+		void print(llvm::raw_ostream & O) const;
+	};
+}
+
+#endif // BATCH_DRIVER_H
@@ -0,0 +1,70 @@
+#ifndef QUERY_DAEMON_H
+#define QUERY_DAEMON_H
+
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/PassManager.h>
+
+#include <MemoryAccess.h>
+#include <MemoryLocality.h>
+
+namespace MemoryAnalysisDriver {
+
+	// Keeps a module and its summaries in memory, and answers queries on
+	// a Unix domain socket. One query per line, each answer ends with a
+	// line holding a single '.':
+	//	summary <function>		MemoryAccess summary
+	//	summarise <function>		yes / no
+	//	locality <function>		One locality edge target per line
+	//	maymodify <function> <global>	yes / no
+	// The bitcode file is checked before each query. If its modification
+	// time, size or inode changed, the module is reloaded. Answers about a
+	// function are kept if neither its body nor those of the functions it
+	// reaches through direct calls changed. Other answers, and the
+	// locality graph, are computed again on first use.
+	// Any number of clients may be connected. Their queries are answered
+	// in turn, on one thread, since the passes are not thread safe.
+	class QueryDaemon {
+	protected:
+		std::string m_bitcodePath;
+		std::string m_socketPath;
+		// Of the bitcode file, when it was loaded
+		struct stat m_status;
+		llvm::LLVMContext * m_context;
+		llvm::Module * m_module;
+		MemoryAccessPass::MemoryAccess * m_memoryAccess;
+		// Owns m_locality
+		llvm::PassManager * m_localityPasses;
+		MemoryLocality::MemoryLocality * m_locality;
+		// Connected clients, and what they sent that is not answered yet
+		std::map<int, std::string> m_clients;
+		// Per function, answers to summary, summarise and maymodify
+		// queries by query
+		std::map<std::string, std::map<std::string, std::string> > m_answers;
+
+		bool load();
+		void unload();
+		bool reloadIfChanged();
+		bool runLocality(std::string & error);
+		// False once the client is gone
+		bool serve(int fd, std::string & pending);
+		void answer(const std::string & query, llvm::raw_ostream & O);
+		// False if the answer is an error, and should not be kept
+		bool answerFunction(const std::string & command, llvm::Function & F,
+				const std::string & globalName, llvm::raw_ostream & O);
+		llvm::Function * getFunction(const std::string & name, llvm::raw_ostream & O);
+	public:
+		QueryDaemon(const std::string & bitcodePath,
+				const std::string & socketPath);
+		~QueryDaemon();
+		// Returns when interrupted
+		int run();
+	};
+}
+
+#endif // QUERY_DAEMON_H
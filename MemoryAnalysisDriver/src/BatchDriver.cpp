@@ -0,0 +1,162 @@
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <BatchDriver.h>
+
+namespace MemoryAnalysisDriver {
+
+BatchDriver::BatchDriver(AnalyseModuleFunction analyse,
+		const std::vector<std::string> & filenames,
+		bool isLazy, unsigned queueDepth) :
+		m_analyse(analyse), m_filenames(filenames), m_isLazy(isLazy),
+		m_queueDepth(queueDepth ? queueDepth : 1), m_nextFile(0),
+		m_activeParsers(0), m_results(filenames.size()),
+		m_isFailed(filenames.size(), false) {
+	pthread_mutex_init(&m_mutex, 0);
+	pthread_cond_init(&m_notEmpty, 0);
+	pthread_cond_init(&m_notFull, 0);
+}
+
+BatchDriver::~BatchDriver() {
+	pthread_cond_destroy(&m_notFull);
+	pthread_cond_destroy(&m_notEmpty);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void * BatchDriver::parseThread(void * driver) {
+	static_cast<BatchDriver *>(driver)->parse();
+	return 0;
+}
+
+void * BatchDriver::analyseThread(void * driver) {
+	static_cast<BatchDriver *>(driver)->analyse();
+	return 0;
+}
+
+void BatchDriver::parse() {
+	while (true) {
+		pthread_mutex_lock(&m_mutex);
+		unsigned index = m_nextFile;
+		if (index < m_filenames.size()) {
+			m_nextFile++;
+		}
+		pthread_mutex_unlock(&m_mutex);
+		if (index >= m_filenames.size()) {
+			break;
+		}
+		Job job;
+		job.index = index;
+		job.context = new llvm::LLVMContext();
+		llvm::SMDiagnostic error;
+		if (m_isLazy) {
+			job.module = llvm::getLazyIRFileModule(m_filenames[index], error,
+					*job.context);
+		} else {
+			job.module = llvm::ParseIRFile(m_filenames[index], error,
+					*job.context);
+		}
+		if (!job.module) {
+			std::string message;
+			llvm::raw_string_ostream stream(message);
+			error.print("memanalysis", stream);
+			stream.flush();
+			delete job.context;
+			pthread_mutex_lock(&m_mutex);
+			m_results[index] = message;
+			m_isFailed[index] = true;
+			pthread_mutex_unlock(&m_mutex);
+			continue;
+		}
+		push(job);
+	}
+	pthread_mutex_lock(&m_mutex);
+	m_activeParsers--;
+	if (m_activeParsers == 0) {
+		// Wake up analysers waiting for modules that will not come
+		pthread_cond_broadcast(&m_notEmpty);
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void BatchDriver::analyse() {
+	Job job;
+	while (pop(job)) {
+		std::string result;
+		llvm::raw_string_ostream stream(result);
+		int status = m_analyse(*job.module, stream);
+		stream.flush();
+		delete job.module;
+		delete job.context;
+		pthread_mutex_lock(&m_mutex);
+		m_results[job.index].swap(result);
+		m_isFailed[job.index] = (status != 0);
+		pthread_mutex_unlock(&m_mutex);
+	}
+}
+
+void BatchDriver::push(const Job & job) {
+	pthread_mutex_lock(&m_mutex);
+	// Bounds the number of parsed modules held in memory
+	while (m_queue.size() >= m_queueDepth) {
+		pthread_cond_wait(&m_notFull, &m_mutex);
+	}
+	m_queue.push_back(job);
+	pthread_cond_signal(&m_notEmpty);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool BatchDriver::pop(Job & job) {
+	pthread_mutex_lock(&m_mutex);
+	while (m_queue.empty() && (m_activeParsers > 0)) {
+		pthread_cond_wait(&m_notEmpty, &m_mutex);
+	}
+	bool isPopped = !m_queue.empty();
+	if (isPopped) {
+		job = m_queue.front();
+		m_queue.pop_front();
+		pthread_cond_signal(&m_notFull);
+	}
+	pthread_mutex_unlock(&m_mutex);
+	return isPopped;
+}
+
+unsigned BatchDriver::run(unsigned parseThreads, unsigned analyseThreads) {
+	if (parseThreads == 0) {
+		parseThreads = 1;
+	}
+	if (analyseThreads == 0) {
+		analyseThreads = 1;
+	}
+	m_activeParsers = parseThreads;
+	std::vector<pthread_t> threads(parseThreads + analyseThreads);
+	for (unsigned idx = 0; idx < parseThreads; idx++) {
+		pthread_create(&threads[idx], 0, parseThread, this);
+	}
+	for (unsigned idx = parseThreads; idx < threads.size(); idx++) {
+		pthread_create(&threads[idx], 0, analyseThread, this);
+	}
+	for (unsigned idx = 0; idx < threads.size(); idx++) {
+		pthread_join(threads[idx], 0);
+	}
+	unsigned failures = 0;
+	for (unsigned idx = 0; idx < m_isFailed.size(); idx++) {
+		if (m_isFailed[idx]) {
+			failures++;
+		}
+	}
+	return failures;
+}
+
+void BatchDriver::print(llvm::raw_ostream & O) const {
+	for (unsigned idx = 0; idx < m_filenames.size(); idx++) {
+		O << "; Module: " << m_filenames[idx] << "\n";
+		if (m_isFailed[idx]) {
+			O << "; Failed\n";
+			llvm::errs() << m_results[idx];
+			continue;
+		}
+		O << m_results[idx];
+	}
+}
+
+}
@@ -0,0 +1,327 @@
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/InitializePasses.h>
+#include <llvm/PassManager.h>
+#include <llvm/PassRegistry.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ManagedStatic.h>
+#include <llvm/Support/PluginLoader.h>
+#include <llvm/Support/PrettyStackTrace.h>
+#include <llvm/Support/Signals.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeValue.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/system_error.h>
+
+#include <BatchDriver.h>
+#include <MemoryAccess.h>
+#include <LocalityPartitioner.h>
+#include <MemoryLocality.h>
+
+// Runs the memaccess or memlocality analysis on a bitcode file without
+// going through opt. The module is opened lazily: function bodies are
+// read when the analysis first reaches them, and dropped once they are
+// summarised.
+// memlocality (and poolalloc, which it requires) is loaded with -load.
+// With several inputs, modules are parsed and analysed concurrently and
+// the results are written in input order.
+
+typedef enum {
+	Analysis_MemoryAccess,
+	Analysis_MemoryLocality
+} AnalysisKind;
+
+static llvm::cl::list<std::string> InputFilenames(llvm::cl::Positional,
+		llvm::cl::desc("<input bitcode>..."), llvm::cl::ZeroOrMore);
+
+static llvm::cl::opt<std::string> InputList("input-list",
+		llvm::cl::desc("File with one input bitcode path per line"),
+		llvm::cl::value_desc("filename"));
+
+static llvm::cl::opt<std::string> OutputFilename("o",
+		llvm::cl::desc("Output filename"), llvm::cl::value_desc("filename"),
+		llvm::cl::init("-"));
+
+static llvm::cl::opt<AnalysisKind> Analysis("analysis",
+		llvm::cl::desc("Analysis to run"),
+		llvm::cl::values(
+			clEnumValN(Analysis_MemoryAccess, "memaccess",
+					"Function memory access summaries"),
+			clEnumValN(Analysis_MemoryLocality, "memlocality",
+					"Module memory locality graph"),
+			clEnumValEnd),
+		llvm::cl::init(Analysis_MemoryAccess));
+
+static llvm::cl::opt<bool> Lazy("lazy",
+		llvm::cl::desc("Materialize function bodies on first use"),
+		llvm::cl::init(true));
+
+static llvm::cl::list<std::string> Functions("function",
+		llvm::cl::desc("Function to summarise (memaccess). "
+				"Default: All functions with a body"),
+		llvm::cl::value_desc("name"));
+
+static llvm::cl::opt<std::string> GraphFilename("graph-output",
+		llvm::cl::desc("Also write the locality graph in binary form "
+				"(memlocality, single input only)"),
+		llvm::cl::value_desc("filename"));
+
+static llvm::cl::opt<unsigned> Partitions("partitions",
+		llvm::cl::desc("Split functions and globals into this many groups by "
+				"locality (memlocality, single input only)"),
+		llvm::cl::init(0));
+
+static llvm::cl::opt<unsigned> Imbalance("imbalance",
+		llvm::cl::desc("Percent a group may weigh over an even share"),
+		llvm::cl::init(5));
+
+static llvm::cl::opt<std::string> PlacementFilename("placement-output",
+		llvm::cl::desc("Placement file written with -partitions"),
+		llvm::cl::value_desc("filename"), llvm::cl::init("-"));
+
+static llvm::cl::opt<unsigned> ParseThreads("parse-threads",
+		llvm::cl::desc("Threads parsing modules (several inputs only)"),
+		llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned> AnalysisThreads("analysis-threads",
+		llvm::cl::desc("Threads analysing modules (several inputs only)"),
+		llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned> QueueDepth("queue-depth",
+		llvm::cl::desc("Parsed modules waiting for analysis at most"),
+		llvm::cl::init(4));
+
+// In batch mode, each requested function is only defined in some modules
+static bool IsBatch = false;
+
+static int runMemoryAccess(llvm::Module & M, llvm::raw_ostream & O) {
+	std::vector<llvm::Function *> functions;
+	if (Functions.empty()) {
+		for (llvm::Module::iterator it = M.begin(), ie = M.end();
+				it != ie; it++) {
+			if (!it->isDeclaration() || it->isMaterializable()) {
+				functions.push_back(&*it);
+			}
+		}
+	} else {
+		for (unsigned idx = 0; idx < Functions.size(); idx++) {
+			llvm::Function * F = M.getFunction(Functions[idx]);
+			if (!F && IsBatch) {
+				continue;
+			}
+			if (!F) {
+				llvm::errs() << "Function not found: " << Functions[idx] << "\n";
+				return 1;
+			}
+			functions.push_back(F);
+		}
+	}
+	MemoryAccessPass::MemoryAccess memoryAccess;
+	// Only the pinned functions are printed
+	memoryAccess.setDropCalleeData(true);
+	// Printed in full, so keep their bodies until they are printed
+	for (std::vector<llvm::Function *>::iterator it = functions.begin(),
+							ie = functions.end();
+			it != ie; it++) {
+		memoryAccess.pin(*it);
+	}
+	for (std::vector<llvm::Function *>::iterator it = functions.begin(),
+							ie = functions.end();
+			it != ie; it++) {
+		llvm::Function * F = *it;
+		const MemoryAccessPass::MemoryAccessInstVisitor * visitor =
+				memoryAccess.getVisitor(F);
+		memoryAccess.print(O, *visitor);
+		memoryAccess.release(F);
+	}
+	return 0;
+}
+
+static bool writePlacement(llvm::Module & M,
+		const MemoryLocality::MemoryLocality & locality) {
+	MemoryLocality::LocalityPartitioner partitioner;
+	for (llvm::Module::iterator it = M.begin(), ie = M.end(); it != ie; it++) {
+		if (!it->isDeclaration() || it->isMaterializable()) {
+			partitioner.addNode(it->getName().str(),
+					MemoryLocality::LocalityPartitioner::Node_Function);
+		}
+	}
+	for (llvm::Module::global_iterator it = M.global_begin(), ie = M.global_end();
+			it != ie; it++) {
+		if (!it->isDeclaration()) {
+			partitioner.addNode(it->getName().str(),
+					MemoryLocality::LocalityPartitioner::Node_Global);
+		}
+	}
+	partitioner.addGraph(locality.getGraph());
+	partitioner.addGraph(locality.getGlobalGraph());
+	partitioner.partition(Partitions, Imbalance);
+	std::string errorInfo;
+	llvm::tool_output_file output(PlacementFilename.c_str(), errorInfo);
+	if (!errorInfo.empty()) {
+		llvm::errs() << errorInfo << "\n";
+		return false;
+	}
+	partitioner.print(output.os());
+	output.keep();
+	return true;
+}
+
+static int runMemoryLocality(llvm::Module & M, llvm::raw_ostream & O) {
+	const llvm::PassInfo * info = llvm::PassRegistry::getPassRegistry()->
+			getPassInfo(llvm::StringRef("memlocality"));
+	if (!info) {
+		llvm::errs() << "memlocality is not registered. "
+				"Load libmemlocality.so with -load\n";
+		return 1;
+	}
+	llvm::PassManager passManager;
+	passManager.add(new llvm::DataLayout(&M));
+	llvm::Pass * pass = info->createPass();
+	passManager.add(pass);
+	passManager.run(M);
+	pass->print(O, &M);
+	// Built without RTTI. The registry entry is known to be this class.
+	MemoryLocality::MemoryLocality * locality =
+			static_cast<MemoryLocality::MemoryLocality *>(pass);
+	if ((Partitions > 0) && !IsBatch && !writePlacement(M, *locality)) {
+		return 1;
+	}
+	if (GraphFilename.empty() || IsBatch) {
+		return 0;
+	}
+	std::string errorInfo;
+	llvm::tool_output_file graphOutput(GraphFilename.c_str(), errorInfo,
+			llvm::raw_fd_ostream::F_Binary);
+	if (!errorInfo.empty()) {
+		llvm::errs() << errorInfo << "\n";
+		return 1;
+	}
+	locality->getGraph().writeBinary(graphOutput.os());
+	graphOutput.keep();
+	return 0;
+}
+
+static bool readInputList(const std::string & path,
+		std::vector<std::string> & filenames) {
+	llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+	if (llvm::error_code error = llvm::MemoryBuffer::getFile(path, buffer)) {
+		llvm::errs() << "Could not read " << path << ": " <<
+				error.message() << "\n";
+		return false;
+	}
+	llvm::SmallVector<llvm::StringRef, 64> lines;
+	buffer->getBuffer().split(lines, "\n", -1, false);
+	for (unsigned idx = 0; idx < lines.size(); idx++) {
+		llvm::StringRef line = lines[idx].trim();
+		if (!line.empty()) {
+			filenames.push_back(line.str());
+		}
+	}
+	return true;
+}
+
+static int runSingle(const std::string & filename,
+		MemoryAnalysisDriver::AnalyseModuleFunction analyse,
+		llvm::raw_ostream & O) {
+	llvm::LLVMContext context;
+	llvm::SMDiagnostic error;
+	llvm::OwningPtr<llvm::Module> module;
+	if (Lazy) {
+		module.reset(llvm::getLazyIRFileModule(filename, error, context));
+	} else {
+		module.reset(llvm::ParseIRFile(filename, error, context));
+	}
+	if (!module) {
+		error.print("memanalysis", llvm::errs());
+		return 1;
+	}
+	return analyse(*module, O);
+}
+
+static int runBatch(const std::vector<std::string> & filenames,
+		MemoryAnalysisDriver::AnalyseModuleFunction analyse,
+		llvm::raw_ostream & O) {
+	if (!llvm::llvm_start_multithreaded()) {
+		llvm::errs() << "LLVM was built without thread support\n";
+		return 1;
+	}
+	IsBatch = true;
+	MemoryAnalysisDriver::BatchDriver driver(analyse, filenames, Lazy,
+			QueueDepth);
+	llvm::sys::TimeValue start = llvm::sys::TimeValue::now();
+	unsigned failures = driver.run(ParseThreads, AnalysisThreads);
+	llvm::sys::TimeValue elapsed = llvm::sys::TimeValue::now() - start;
+	driver.print(O);
+	double seconds = elapsed.usec() / 1000000.0;
+	llvm::errs() << filenames.size() << " modules in " << seconds << "s";
+	if (seconds > 0) {
+		llvm::errs() << " (" << (filenames.size() / seconds) << " modules/sec)";
+	}
+	llvm::errs() << ", " << failures << " failed\n";
+	return (failures == 0) ? 0 : 1;
+}
+
+int main(int argc, char ** argv) {
+	llvm::sys::PrintStackTraceOnErrorSignal();
+	llvm::PrettyStackTraceProgram stackTrace(argc, argv);
+	llvm::llvm_shutdown_obj shutdown;
+
+	llvm::PassRegistry & registry = *llvm::PassRegistry::getPassRegistry();
+	llvm::initializeCore(registry);
+	llvm::initializeAnalysis(registry);
+	llvm::initializeIPA(registry);
+
+	llvm::cl::ParseCommandLineOptions(argc, argv,
+			"Memory access and locality analysis driver\n");
+
+	std::vector<std::string> filenames(InputFilenames.begin(),
+			InputFilenames.end());
+	if (!InputList.empty() && !readInputList(InputList, filenames)) {
+		return 1;
+	}
+	if (filenames.empty()) {
+		llvm::errs() << argv[0] << ": No input files\n";
+		return 1;
+	}
+
+	std::string errorInfo;
+	llvm::OwningPtr<llvm::tool_output_file> output(
+			new llvm::tool_output_file(OutputFilename.c_str(), errorInfo));
+	if (!errorInfo.empty()) {
+		llvm::errs() << errorInfo << "\n";
+		return 1;
+	}
+
+	MemoryAnalysisDriver::AnalyseModuleFunction analyse = runMemoryAccess;
+	if (Analysis == Analysis_MemoryLocality) {
+		analyse = runMemoryLocality;
+	}
+
+	if ((!GraphFilename.empty() || (Partitions > 0)) && (filenames.size() > 1)) {
+		llvm::errs() << "-graph-output and -partitions take a single input\n";
+		return 1;
+	}
+
+	int result;
+	if (filenames.size() == 1) {
+		result = runSingle(filenames[0], analyse, output->os());
+	} else {
+		result = runBatch(filenames, analyse, output->os());
+	}
+	if (result == 0) {
+		output->keep();
+	}
+	return result;
+}
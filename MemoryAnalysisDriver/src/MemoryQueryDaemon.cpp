@@ -0,0 +1,39 @@
+#include <string>
+
+#include <llvm/InitializePasses.h>
+#include <llvm/PassRegistry.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/ManagedStatic.h>
+#include <llvm/Support/PluginLoader.h>
+#include <llvm/Support/PrettyStackTrace.h>
+#include <llvm/Support/Signals.h>
+
+#include <QueryDaemon.h>
+
+// Serves memaccess and memlocality queries about one bitcode file over a
+// Unix domain socket. See QueryDaemon.h for the protocol.
+// memlocality (and poolalloc, which it requires) is loaded with -load.
+
+static llvm::cl::opt<std::string> InputFilename(llvm::cl::Positional,
+		llvm::cl::desc("<input bitcode>"), llvm::cl::Required);
+
+static llvm::cl::opt<std::string> SocketPath("socket",
+		llvm::cl::desc("Unix domain socket to listen on"),
+		llvm::cl::value_desc("path"), llvm::cl::init("memqueryd.sock"));
+
+int main(int argc, char ** argv) {
+	llvm::sys::PrintStackTraceOnErrorSignal();
+	llvm::PrettyStackTraceProgram stackTrace(argc, argv);
+	llvm::llvm_shutdown_obj shutdown;
+
+	llvm::PassRegistry & registry = *llvm::PassRegistry::getPassRegistry();
+	llvm::initializeCore(registry);
+	llvm::initializeAnalysis(registry);
+	llvm::initializeIPA(registry);
+
+	llvm::cl::ParseCommandLineOptions(argc, argv,
+			"Memory access and locality query daemon\n");
+
+	MemoryAnalysisDriver::QueryDaemon daemon(InputFilename, SocketPath);
+	return daemon.run();
+}
@@ -0,0 +1,379 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <vector>
+
+#include <llvm/ADT/Hashing.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/PassRegistry.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <QueryDaemon.h>
+
+namespace MemoryAnalysisDriver {
+
+static volatile sig_atomic_t isInterrupted = 0;
+
+static void interrupt(int signal) {
+	isInterrupted = 1;
+}
+
+// st_mtime alone has one second granularity: A file rewritten within the
+// same second would not be reloaded
+static bool isSameFile(const struct stat & a, const struct stat & b) {
+	return (a.st_mtim.tv_sec == b.st_mtim.tv_sec) &&
+			(a.st_mtim.tv_nsec == b.st_mtim.tv_nsec) &&
+			(a.st_size == b.st_size) && (a.st_ino == b.st_ino) &&
+			(a.st_dev == b.st_dev);
+}
+
+// Hashes of the printed bodies of F and of the functions it reaches
+// through direct calls, by name. False if it reaches an indirect call, or
+// a body could not be read.
+static bool getReachedBodies(llvm::Function * F, std::map<std::string, size_t> & hashes) {
+	std::vector<llvm::Function *> worklist;
+	worklist.push_back(F);
+	while (!worklist.empty()) {
+		llvm::Function * G = worklist.back();
+		worklist.pop_back();
+		if (hashes.count(G->getName().str())) {
+			continue;
+		}
+		if (G->isMaterializable()) {
+			std::string error;
+			if (G->Materialize(&error)) {
+				return false;
+			}
+		}
+		std::string body;
+		llvm::raw_string_ostream stream(body);
+		G->print(stream);
+		hashes[G->getName().str()] = llvm::hash_value(stream.str());
+		for (llvm::Function::iterator bit = G->begin(), bie = G->end();
+				bit != bie; bit++) {
+			for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+					it != ie; it++) {
+				llvm::CallInst * ci = llvm::dyn_cast<llvm::CallInst>(&*it);
+				if (!ci || llvm::isa<llvm::InlineAsm>(ci->getCalledValue())) {
+					continue;
+				}
+				llvm::Function * callee = ci->getCalledFunction();
+				if (!callee) {
+					return false;
+				}
+				worklist.push_back(callee);
+			}
+		}
+	}
+	return true;
+}
+
+QueryDaemon::QueryDaemon(const std::string & bitcodePath,
+		const std::string & socketPath) :
+		m_bitcodePath(bitcodePath), m_socketPath(socketPath),
+		m_context(0), m_module(0), m_memoryAccess(0),
+		m_localityPasses(0), m_locality(0) {
+	memset(&m_status, 0, sizeof(m_status));
+}
+
+QueryDaemon::~QueryDaemon() {
+	unload();
+}
+
+bool QueryDaemon::load() {
+	if (stat(m_bitcodePath.c_str(), &m_status) != 0) {
+		llvm::errs() << "Could not stat " << m_bitcodePath << "\n";
+		return false;
+	}
+	m_context = new llvm::LLVMContext();
+	llvm::SMDiagnostic error;
+	// Bodies are read as queries reach them
+	m_module = llvm::getLazyIRFileModule(m_bitcodePath, error, *m_context);
+	if (!m_module) {
+		error.print("memqueryd", llvm::errs());
+		delete m_context;
+		m_context = 0;
+		return false;
+	}
+	m_memoryAccess = new MemoryAccessPass::MemoryAccess();
+	return true;
+}
+
+void QueryDaemon::unload() {
+	// Summaries and passes refer to the module, which refers to the context
+	delete m_localityPasses;
+	m_localityPasses = 0;
+	m_locality = 0;
+	delete m_memoryAccess;
+	m_memoryAccess = 0;
+	delete m_module;
+	m_module = 0;
+	delete m_context;
+	m_context = 0;
+}
+
+bool QueryDaemon::reloadIfChanged() {
+	struct stat status;
+	if (m_module && (stat(m_bitcodePath.c_str(), &status) == 0) &&
+			isSameFile(status, m_status)) {
+		return true;
+	}
+	// What each function with kept answers reaches, before the reload
+	std::map<std::string, std::map<std::string, size_t> > reached;
+	for (std::map<std::string, std::map<std::string, std::string> >::iterator it = m_answers.begin(),
+										ie = m_answers.end();
+			m_module && (it != ie); it++) {
+		llvm::Function * F = m_module->getFunction(it->first);
+		std::map<std::string, size_t> & hashes = reached[it->first];
+		if (!F || !getReachedBodies(F, hashes)) {
+			reached.erase(it->first);
+		}
+	}
+	unload();
+	if (!load()) {
+		m_answers.clear();
+		return false;
+	}
+	for (std::map<std::string, std::map<std::string, std::string> >::iterator it = m_answers.begin();
+			it != m_answers.end();) {
+		llvm::Function * F = m_module->getFunction(it->first);
+		std::map<std::string, size_t> hashes;
+		std::map<std::string, std::map<std::string, size_t> >::iterator rit =
+				reached.find(it->first);
+		if (F && (rit != reached.end()) && getReachedBodies(F, hashes) &&
+				(hashes == rit->second)) {
+			it++;
+		} else {
+			m_answers.erase(it++);
+		}
+	}
+	return true;
+}
+
+bool QueryDaemon::runLocality(std::string & error) {
+	if (m_locality) {
+		return true;
+	}
+	const llvm::PassInfo * info = llvm::PassRegistry::getPassRegistry()->
+			getPassInfo(llvm::StringRef("memlocality"));
+	if (!info) {
+		error = "memlocality is not registered. Load libmemlocality.so with -load";
+		return false;
+	}
+	m_localityPasses = new llvm::PassManager();
+	m_localityPasses->add(new llvm::DataLayout(m_module));
+	llvm::Pass * pass = info->createPass();
+	m_localityPasses->add(pass);
+	m_localityPasses->run(*m_module);
+	// Built without RTTI. The registry entry is known to be this class.
+	m_locality = static_cast<MemoryLocality::MemoryLocality *>(pass);
+	return true;
+}
+
+llvm::Function * QueryDaemon::getFunction(const std::string & name,
+		llvm::raw_ostream & O) {
+	llvm::Function * F = m_module->getFunction(name);
+	if (!F) {
+		O << "error No such function: " << name << "\n";
+	}
+	return F;
+}
+
+void QueryDaemon::answer(const std::string & query, llvm::raw_ostream & O) {
+	std::istringstream stream(query);
+	std::string command, name;
+	stream >> command >> name;
+	if (command.empty()) {
+		return;
+	}
+	if ((command != "summary") && (command != "summarise") &&
+			(command != "locality") && (command != "maymodify")) {
+		O << "error Unknown query: " << command << "\n.\n";
+		return;
+	}
+	if (!reloadIfChanged()) {
+		O << "error Could not load " << m_bitcodePath << "\n.\n";
+		return;
+	}
+	llvm::Function * F = getFunction(name, O);
+	if (!F) {
+		O << ".\n";
+		return;
+	}
+	if (command == "locality") {
+		std::string error;
+		if (!runLocality(error)) {
+			O << "error " << error << "\n";
+		} else {
+			const MemoryLocality::LocalityGraph & graph = m_locality->getGraph();
+			MemoryLocality::LocalityGraph::NodeId u;
+			if (graph.getNode(F->getName().str(), u)) {
+				for (unsigned edge = graph.getEdgesBegin(u); edge < graph.getEdgesEnd(u);
+						edge++) {
+					O << graph.getName(graph.getTarget(edge)) << "\n";
+				}
+			}
+		}
+	} else {
+		std::string globalName;
+		stream >> globalName;
+		std::string key = command + " " + globalName;
+		std::map<std::string, std::map<std::string, std::string> >::iterator it =
+				m_answers.find(name);
+		if ((it != m_answers.end()) && it->second.count(key)) {
+			O << it->second[key];
+		} else {
+			std::string result;
+			llvm::raw_string_ostream resultStream(result);
+			if (answerFunction(command, *F, globalName, resultStream)) {
+				m_answers[name][key] = resultStream.str();
+			}
+			O << resultStream.str();
+		}
+	}
+	O << ".\n";
+}
+
+bool QueryDaemon::answerFunction(const std::string & command, llvm::Function & F,
+		const std::string & globalName, llvm::raw_ostream & O) {
+	if (command == "summary") {
+		m_memoryAccess->print(O, *m_memoryAccess->getVisitor(&F));
+	} else if (command == "summarise") {
+		bool isSummarise = m_memoryAccess->getVisitor(&F)->isSummariseFunction();
+		O << (isSummarise ? "yes" : "no") << "\n";
+	} else {
+		llvm::GlobalValue * global = m_module->getNamedValue(globalName);
+		if (!global) {
+			O << "error No such global: " << globalName << "\n";
+			return false;
+		}
+		bool isModified = m_memoryAccess->mayModifyGlobal(F, global);
+		O << (isModified ? "yes" : "no") << "\n";
+	}
+	return true;
+}
+
+bool QueryDaemon::serve(int fd, std::string & pending) {
+	char buffer[4096];
+	ssize_t count = read(fd, buffer, sizeof(buffer));
+	if (count <= 0) {
+		return (count < 0) && (errno == EINTR);
+	}
+	pending.append(buffer, count);
+	// Answer every complete line read so far in one write: Clients
+	// batch queries
+	std::string response;
+	llvm::raw_string_ostream O(response);
+	std::string::size_type start = 0;
+	std::string::size_type end;
+	while ((end = pending.find('\n', start)) != std::string::npos) {
+		answer(pending.substr(start, end - start), O);
+		start = end + 1;
+	}
+	pending.erase(0, start);
+	O.flush();
+	const char * data = response.data();
+	size_t left = response.size();
+	while (left > 0) {
+		ssize_t written = write(fd, data, left);
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		left -= written;
+	}
+	return true;
+}
+
+int QueryDaemon::run() {
+	if (!load()) {
+		return 1;
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (m_socketPath.size() >= sizeof(address.sun_path)) {
+		llvm::errs() << "Socket path too long: " << m_socketPath << "\n";
+		return 1;
+	}
+	strcpy(address.sun_path, m_socketPath.c_str());
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		llvm::errs() << "socket: " << strerror(errno) << "\n";
+		return 1;
+	}
+	unlink(m_socketPath.c_str());
+	if ((bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+			(listen(listener, 16) != 0)) {
+		llvm::errs() << "Could not listen on " << m_socketPath << ": " <<
+				strerror(errno) << "\n";
+		close(listener);
+		return 1;
+	}
+	// No SA_RESTART: poll and read return on interruption
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = interrupt;
+	sigaction(SIGINT, &action, 0);
+	sigaction(SIGTERM, &action, 0);
+	signal(SIGPIPE, SIG_IGN);
+	std::vector<struct pollfd> fds;
+	while (!isInterrupted) {
+		fds.clear();
+		struct pollfd entry;
+		entry.fd = listener;
+		entry.events = POLLIN;
+		entry.revents = 0;
+		fds.push_back(entry);
+		for (std::map<int, std::string>::iterator it = m_clients.begin(),
+								ie = m_clients.end();
+				it != ie; it++) {
+			entry.fd = it->first;
+			fds.push_back(entry);
+		}
+		if (poll(&fds[0], fds.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			llvm::errs() << "poll: " << strerror(errno) << "\n";
+			break;
+		}
+		for (std::vector<struct pollfd>::iterator it = fds.begin() + 1, ie = fds.end();
+				it != ie; it++) {
+			if (it->revents && !serve(it->fd, m_clients[it->fd])) {
+				close(it->fd);
+				m_clients.erase(it->fd);
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listener, 0, 0);
+			if (fd >= 0) {
+				m_clients[fd];
+			} else if (errno != EINTR) {
+				llvm::errs() << "accept: " << strerror(errno) << "\n";
+			}
+		}
+	}
+	for (std::map<int, std::string>::iterator it = m_clients.begin(),
+							ie = m_clients.end();
+			it != ie; it++) {
+		close(it->first);
+	}
+	m_clients.clear();
+	close(listener);
+	unlink(m_socketPath.c_str());
+	return 0;
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef LOCALITY_CHECKPOINT_H
+#define LOCALITY_CHECKPOINT_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <LocalityGraph.h>
+#include <MemoryLocality.h>
+
+namespace llvm {
+	class Function;
+	class Instruction;
+	class Module;
+}
+
+namespace MemoryLocality {
+
+	// Checkpoint files are read by another process on the same module, so
+	// values are named rather than pointed to: Functions by name,
+	// instructions by function and position, arguments by function and
+	// number. Words are 32 bit little endian, strings are length prefixed.
+	class CheckpointWriter {
+	protected:
+		llvm::raw_ostream & O;
+		std::map<const llvm::Function *, std::map<const llvm::Instruction *, unsigned> > m_positions;
+	public:
+		CheckpointWriter(llvm::raw_ostream & O) : O(O) {}
+
+		void writeWord(unsigned word);
+		void writeCount(uint64_t count);
+		void writeString(const std::string & string);
+		// Null is written as the empty name
+		void writeFunction(const llvm::Function * F);
+		void writeInstruction(const llvm::Instruction * I);
+		void writeSource(const PointerSource & source);
+		void writeGraph(const LocalityGraph & graph);
+	};
+
+	// Hash of the names and instruction counts of M's functions, so that a
+	// checkpoint of another module is not resumed. Bodies not read yet are
+	// brought in to count them, and dropped again.
+	uint64_t getModuleFingerprint(llvm::Module & M);
+
+	// Any read failing leaves the reader invalid, and all further reads
+	// fail.
+	class CheckpointReader {
+	protected:
+		llvm::Module & M;
+		llvm::StringRef m_data;
+		bool m_isValid;
+		std::map<llvm::Function *, std::vector<llvm::Instruction *> > m_instructions;
+
+		bool fail();
+	public:
+		// Bodies brought in to find instructions
+		std::set<llvm::Function *> materialized;
+
+		CheckpointReader(llvm::Module & M, llvm::StringRef data) :
+				M(M), m_data(data), m_isValid(true) {}
+
+		bool isValid() const { return m_isValid; }
+		bool isAtEnd() const { return m_data.empty(); }
+		bool readWord(unsigned & word);
+		bool readCount(uint64_t & count);
+		bool readString(std::string & string);
+		bool readFunction(llvm::Function *& F);
+		bool readInstruction(llvm::Instruction *& I);
+		bool readSource(PointerSource & source);
+		bool readGraph(LocalityGraph & graph);
+	};
+}
+#endif // LOCALITY_CHECKPOINT_H
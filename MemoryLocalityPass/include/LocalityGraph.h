@@ -0,0 +1,363 @@
+#ifndef LOCALITY_GRAPH_H
+#define LOCALITY_GRAPH_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace MemoryLocality {
+
+	// Weighted locality graph. Edges are collected in a map while the
+	// analysis runs, and packed into compressed sparse rows by finalize():
+	// The edges of node u are [offsets[u], offsets[u + 1]) in targets and
+	// weights, sorted by target.
+	// Header only: The driver uses it without linking the pass.
+	//
+	// Binary format, all words 32 bit little endian:
+	//	"MLGR" version nodeCount edgeCount
+	//	nodeCount times: length, then the name's bytes
+	//	offsets (nodeCount + 1 words), targets, weights (edgeCount words each)
+	class LocalityGraph {
+	public:
+		typedef unsigned NodeId;
+		static const unsigned Version = 1;
+	protected:
+		std::vector<std::string> m_names;
+		std::map<std::string, NodeId> m_ids;
+		std::map<std::pair<NodeId, NodeId>, unsigned> m_pending;
+		std::vector<unsigned> m_offsets;
+		std::vector<NodeId> m_targets;
+		std::vector<unsigned> m_weights;
+
+		static void writeWord(llvm::raw_ostream & O, unsigned word) {
+			char bytes[4];
+			for (unsigned idx = 0; idx < 4; idx++) {
+				bytes[idx] = (word >> (8 * idx)) & 0xff;
+			}
+			O.write(bytes, 4);
+		}
+
+		static bool readWord(llvm::StringRef & data, unsigned & word) {
+			if (data.size() < 4) {
+				return false;
+			}
+			word = 0;
+			for (unsigned idx = 0; idx < 4; idx++) {
+				word |= ((unsigned)(unsigned char)data[idx]) << (8 * idx);
+			}
+			data = data.substr(4);
+			return true;
+		}
+
+		static bool isHeavier(const std::pair<unsigned, std::pair<NodeId, NodeId> > & a,
+				const std::pair<unsigned, std::pair<NodeId, NodeId> > & b) {
+			if (a.first != b.first) {
+				return a.first > b.first;
+			}
+			return a.second < b.second;
+		}
+
+	public:
+		NodeId addNode(const std::string & name) {
+			std::map<std::string, NodeId>::iterator it = m_ids.find(name);
+			if (it != m_ids.end()) {
+				return it->second;
+			}
+			NodeId result = m_names.size();
+			m_names.push_back(name);
+			m_ids.insert(std::make_pair(name, result));
+			return result;
+		}
+
+		void addEdge(NodeId u, NodeId v, unsigned weight = 1) {
+			m_pending[std::make_pair(u, v)] += weight;
+		}
+
+		void addEdge(const std::string & u, const std::string & v, unsigned weight = 1) {
+			NodeId uid = addNode(u);
+			addEdge(uid, addNode(v), weight);
+		}
+
+		// Packs the edges added since the last call
+		void finalize() {
+			if (m_pending.empty() && (m_offsets.size() == m_names.size() + 1)) {
+				return;
+			}
+			for (NodeId u = 0; u + 1 < m_offsets.size(); u++) {
+				for (unsigned idx = m_offsets[u]; idx < m_offsets[u + 1]; idx++) {
+					m_pending[std::make_pair(u, m_targets[idx])] += m_weights[idx];
+				}
+			}
+			m_offsets.assign(m_names.size() + 1, 0);
+			m_targets.clear();
+			m_weights.clear();
+			m_targets.reserve(m_pending.size());
+			m_weights.reserve(m_pending.size());
+			for (std::map<std::pair<NodeId, NodeId>, unsigned>::iterator it = m_pending.begin(),
+											ie = m_pending.end();
+					it != ie; it++) {
+				m_offsets[it->first.first + 1]++;
+				m_targets.push_back(it->first.second);
+				m_weights.push_back(it->second);
+			}
+			for (NodeId u = 0; u < m_names.size(); u++) {
+				m_offsets[u + 1] += m_offsets[u];
+			}
+			m_pending.clear();
+		}
+
+		void clear() {
+			m_names.clear();
+			m_ids.clear();
+			m_pending.clear();
+			m_offsets.clear();
+			m_targets.clear();
+			m_weights.clear();
+		}
+
+		unsigned getNodeCount() const { return m_names.size(); }
+		unsigned getEdgeCount() const { return m_targets.size(); }
+		const std::string & getName(NodeId u) const { return m_names[u]; }
+
+		bool getNode(const std::string & name, NodeId & u) const {
+			std::map<std::string, NodeId>::const_iterator it = m_ids.find(name);
+			if (it == m_ids.end()) {
+				return false;
+			}
+			u = it->second;
+			return true;
+		}
+
+		// Edges of u, as indices into getTarget and getWeight
+		unsigned getEdgesBegin(NodeId u) const {
+			return (u + 1 < m_offsets.size()) ? m_offsets[u] : 0;
+		}
+		unsigned getEdgesEnd(NodeId u) const {
+			return (u + 1 < m_offsets.size()) ? m_offsets[u + 1] : 0;
+		}
+		NodeId getTarget(unsigned edge) const { return m_targets[edge]; }
+		bool hasEdge(NodeId u, NodeId v) const {
+			std::vector<NodeId>::const_iterator begin = m_targets.begin() + getEdgesBegin(u);
+			std::vector<NodeId>::const_iterator end = m_targets.begin() + getEdgesEnd(u);
+			return std::binary_search(begin, end, v);
+		}
+		unsigned getWeight(unsigned edge) const { return m_weights[edge]; }
+
+		// Strongly connected components, numbered in reverse topological
+		// order. Iterative Tarjan.
+		unsigned getComponents(std::vector<unsigned> & components) const {
+			const unsigned none = (unsigned)-1;
+			unsigned count = getNodeCount();
+			components.assign(count, none);
+			std::vector<unsigned> indices(count, none);
+			std::vector<unsigned> lowLinks(count, 0);
+			std::vector<bool> isOnStack(count, false);
+			std::vector<NodeId> stack;
+			// Node, and the next of its edges to follow
+			std::vector<std::pair<NodeId, unsigned> > callStack;
+			unsigned index = 0;
+			unsigned componentCount = 0;
+			for (NodeId root = 0; root < count; root++) {
+				if (indices[root] != none) {
+					continue;
+				}
+				callStack.push_back(std::make_pair(root, getEdgesBegin(root)));
+				indices[root] = lowLinks[root] = index++;
+				stack.push_back(root);
+				isOnStack[root] = true;
+				while (!callStack.empty()) {
+					NodeId u = callStack.back().first;
+					unsigned & edge = callStack.back().second;
+					if (edge < getEdgesEnd(u)) {
+						NodeId v = getTarget(edge++);
+						if (indices[v] == none) {
+							indices[v] = lowLinks[v] = index++;
+							stack.push_back(v);
+							isOnStack[v] = true;
+							callStack.push_back(std::make_pair(v, getEdgesBegin(v)));
+						} else if (isOnStack[v]) {
+							lowLinks[u] = std::min(lowLinks[u], indices[v]);
+						}
+						continue;
+					}
+					callStack.pop_back();
+					if (!callStack.empty()) {
+						NodeId parent = callStack.back().first;
+						lowLinks[parent] = std::min(lowLinks[parent], lowLinks[u]);
+					}
+					if (lowLinks[u] != indices[u]) {
+						continue;
+					}
+					NodeId v;
+					do {
+						v = stack.back();
+						stack.pop_back();
+						isOnStack[v] = false;
+						components[v] = componentCount;
+					} while (v != u);
+					componentCount++;
+				}
+			}
+			return componentCount;
+		}
+
+		// One node per strongly connected component, named after its
+		// first member and its size. Weights of edges between components
+		// are summed. Edges inside a component are dropped.
+		void condense(LocalityGraph & result) const {
+			result.clear();
+			std::vector<unsigned> components;
+			unsigned componentCount = getComponents(components);
+			std::vector<NodeId> representatives(componentCount, getNodeCount());
+			std::vector<unsigned> sizes(componentCount, 0);
+			std::vector<NodeId> ids(componentCount);
+			for (NodeId u = 0; u < getNodeCount(); u++) {
+				unsigned component = components[u];
+				if (representatives[component] == getNodeCount()) {
+					representatives[component] = u;
+				}
+				sizes[component]++;
+			}
+			for (unsigned component = 0; component < componentCount; component++) {
+				std::string name = getName(representatives[component]);
+				if (sizes[component] > 1) {
+					std::string size;
+					llvm::raw_string_ostream stream(size);
+					stream << " (+" << (sizes[component] - 1) << ")";
+					name += stream.str();
+				}
+				ids[component] = result.addNode(name);
+			}
+			for (NodeId u = 0; u < getNodeCount(); u++) {
+				for (unsigned edge = getEdgesBegin(u); edge < getEdgesEnd(u); edge++) {
+					unsigned from = components[u];
+					unsigned to = components[getTarget(edge)];
+					if (from != to) {
+						result.addEdge(ids[from], ids[to], getWeight(edge));
+					}
+				}
+			}
+			result.finalize();
+		}
+
+		// The count heaviest edges, and the nodes they connect
+		void getHeaviest(unsigned count, LocalityGraph & result) const {
+			result.clear();
+			std::vector<std::pair<unsigned, std::pair<NodeId, NodeId> > > edges;
+			edges.reserve(getEdgeCount());
+			for (NodeId u = 0; u < getNodeCount(); u++) {
+				for (unsigned edge = getEdgesBegin(u); edge < getEdgesEnd(u); edge++) {
+					edges.push_back(std::make_pair(getWeight(edge),
+							std::make_pair(u, getTarget(edge))));
+				}
+			}
+			if (count < edges.size()) {
+				std::partial_sort(edges.begin(), edges.begin() + count, edges.end(),
+						isHeavier);
+				edges.resize(count);
+			}
+			for (unsigned idx = 0; idx < edges.size(); idx++) {
+				result.addEdge(getName(edges[idx].second.first),
+						getName(edges[idx].second.second), edges[idx].first);
+			}
+			result.finalize();
+		}
+
+		// Edges only. Nodes without edges are left to the caller.
+		void printDOTEdges(llvm::raw_ostream & O, bool isWeighted = false) const {
+			for (NodeId u = 0; u < getNodeCount(); u++) {
+				for (unsigned edge = getEdgesBegin(u); edge < getEdgesEnd(u); edge++) {
+					O << "\t\"" << getName(u) << "\" -> \"" <<
+							getName(getTarget(edge)) << "\"";
+					if (isWeighted) {
+						O << " [weight=" << getWeight(edge) << "]";
+					}
+					O << ";\n";
+				}
+			}
+		}
+
+		void writeBinary(llvm::raw_ostream & O) const {
+			O << "MLGR";
+			writeWord(O, Version);
+			writeWord(O, getNodeCount());
+			writeWord(O, getEdgeCount());
+			for (NodeId u = 0; u < getNodeCount(); u++) {
+				writeWord(O, m_names[u].size());
+				O << m_names[u];
+			}
+			for (NodeId u = 0; u <= getNodeCount(); u++) {
+				// Nodes added since finalize() have no edges
+				writeWord(O, (u < m_offsets.size()) ? m_offsets[u] : getEdgeCount());
+			}
+			for (unsigned edge = 0; edge < getEdgeCount(); edge++) {
+				writeWord(O, m_targets[edge]);
+			}
+			for (unsigned edge = 0; edge < getEdgeCount(); edge++) {
+				writeWord(O, m_weights[edge]);
+			}
+		}
+
+		// False if data is not a complete graph of this version
+		bool readBinary(llvm::StringRef data) {
+			clear();
+			unsigned version, nodeCount, edgeCount;
+			if (!data.startswith("MLGR")) {
+				return false;
+			}
+			data = data.substr(4);
+			if (!readWord(data, version) || (version != Version) ||
+					!readWord(data, nodeCount) || !readWord(data, edgeCount)) {
+				return false;
+			}
+			for (unsigned idx = 0; idx < nodeCount; idx++) {
+				unsigned length;
+				if (!readWord(data, length) || (data.size() < length)) {
+					clear();
+					return false;
+				}
+				addNode(data.substr(0, length).str());
+				data = data.substr(length);
+			}
+			if (m_names.size() != nodeCount) {
+				// Duplicate names
+				clear();
+				return false;
+			}
+			// Offsets, targets and weights must all be there before
+			// anything is sized by the counts read
+			if ((data.size() / 4 < nodeCount + 1) ||
+					((data.size() / 4 - (nodeCount + 1)) / 2 < edgeCount)) {
+				clear();
+				return false;
+			}
+			m_offsets.resize(nodeCount + 1);
+			m_targets.resize(edgeCount);
+			m_weights.resize(edgeCount);
+			bool isRead = true;
+			for (unsigned idx = 0; isRead && (idx <= nodeCount); idx++) {
+				isRead = readWord(data, m_offsets[idx]) &&
+						(m_offsets[idx] <= edgeCount) &&
+						((idx == 0) || (m_offsets[idx - 1] <= m_offsets[idx]));
+			}
+			for (unsigned idx = 0; isRead && (idx < edgeCount); idx++) {
+				isRead = readWord(data, m_targets[idx]) &&
+						(m_targets[idx] < nodeCount);
+			}
+			for (unsigned idx = 0; isRead && (idx < edgeCount); idx++) {
+				isRead = readWord(data, m_weights[idx]);
+			}
+			if (!isRead || (m_offsets[0] != 0) || (m_offsets[nodeCount] != edgeCount)) {
+				clear();
+				return false;
+			}
+			return true;
+		}
+	};
+}
+#endif // LOCALITY_GRAPH_H
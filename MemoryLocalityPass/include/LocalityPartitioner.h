@@ -0,0 +1,225 @@
+#ifndef LOCALITY_PARTITIONER_H
+#define LOCALITY_PARTITIONER_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <LocalityGraph.h>
+
+namespace MemoryLocality {
+
+	// Splits functions and globals into groups, keeping the locality
+	// edges between groups light. Edges are taken as undirected. A node
+	// weighs 1 plus the weight of its edges, and no group may weigh more
+	// than (100 + imbalance)% of an even share.
+	// Greedy growing places the heaviest nodes first, each in the group it
+	// is most connected to. Then Fiduccia-Mattheyses style passes move
+	// single nodes while that lowers the cut.
+	// Header only: The driver uses it without linking the pass.
+	class LocalityPartitioner {
+	public:
+		typedef enum {
+			Node_Function,
+			Node_Global
+		} NodeKind;
+	protected:
+		struct Node {
+			std::string name;
+			NodeKind kind;
+			unsigned weight;
+			unsigned group;
+			std::map<unsigned, unsigned> neighbours;
+
+			Node(const std::string & name, NodeKind kind) :
+					name(name), kind(kind), weight(1), group(0) {}
+		};
+		std::vector<Node> m_nodes;
+		std::map<std::string, unsigned> m_ids;
+		std::vector<unsigned long> m_groupWeights;
+		unsigned long m_capacity;
+
+		static const unsigned RefinePassCount = 8;
+
+		// Edge weight from node to each group
+		void getConnections(const Node & node, std::vector<unsigned long> & connections) const {
+			connections.assign(m_groupWeights.size(), 0);
+			for (std::map<unsigned, unsigned>::const_iterator it = node.neighbours.begin(),
+									ie = node.neighbours.end();
+					it != ie; it++) {
+				const Node & neighbour = m_nodes[it->first];
+				if (neighbour.group < m_groupWeights.size()) {
+					connections[neighbour.group] += it->second;
+				}
+			}
+		}
+
+		bool isHeavier(unsigned a, unsigned b) const {
+			if (m_nodes[a].weight != m_nodes[b].weight) {
+				return m_nodes[a].weight > m_nodes[b].weight;
+			}
+			return a < b;
+		}
+
+		struct HeavierNode {
+			const LocalityPartitioner * partitioner;
+			HeavierNode(const LocalityPartitioner * partitioner) : partitioner(partitioner) {}
+			bool operator()(unsigned a, unsigned b) const {
+				return partitioner->isHeavier(a, b);
+			}
+		};
+
+		void grow() {
+			unsigned groupCount = m_groupWeights.size();
+			std::vector<unsigned> order(m_nodes.size());
+			for (unsigned idx = 0; idx < order.size(); idx++) {
+				order[idx] = idx;
+				// Unplaced
+				m_nodes[idx].group = groupCount;
+			}
+			std::sort(order.begin(), order.end(), HeavierNode(this));
+			std::vector<unsigned long> connections;
+			for (unsigned idx = 0; idx < order.size(); idx++) {
+				Node & node = m_nodes[order[idx]];
+				getConnections(node, connections);
+				unsigned best = groupCount;
+				for (unsigned group = 0; group < groupCount; group++) {
+					bool isFitting = m_groupWeights[group] + node.weight <= m_capacity;
+					if (!isFitting) {
+						continue;
+					}
+					if ((best == groupCount) ||
+							(connections[group] > connections[best]) ||
+							((connections[group] == connections[best]) &&
+							(m_groupWeights[group] < m_groupWeights[best]))) {
+						best = group;
+					}
+				}
+				if (best == groupCount) {
+					// Too heavy for any group: The lightest takes it
+					best = std::min_element(m_groupWeights.begin(),
+							m_groupWeights.end()) - m_groupWeights.begin();
+				}
+				node.group = best;
+				m_groupWeights[best] += node.weight;
+			}
+		}
+
+		// Returns true if any node moved
+		bool refine() {
+			bool result = false;
+			std::vector<unsigned long> connections;
+			for (unsigned idx = 0; idx < m_nodes.size(); idx++) {
+				Node & node = m_nodes[idx];
+				getConnections(node, connections);
+				unsigned best = node.group;
+				for (unsigned group = 0; group < m_groupWeights.size(); group++) {
+					if ((group == node.group) ||
+							(m_groupWeights[group] + node.weight > m_capacity)) {
+						continue;
+					}
+					if (connections[group] > connections[best]) {
+						best = group;
+					}
+				}
+				if (best != node.group) {
+					m_groupWeights[node.group] -= node.weight;
+					m_groupWeights[best] += node.weight;
+					node.group = best;
+					result = true;
+				}
+			}
+			return result;
+		}
+
+	public:
+		LocalityPartitioner() : m_capacity(0) {}
+
+		unsigned addNode(const std::string & name, NodeKind kind) {
+			std::map<std::string, unsigned>::iterator it = m_ids.find(name);
+			if (it != m_ids.end()) {
+				return it->second;
+			}
+			unsigned result = m_nodes.size();
+			m_nodes.push_back(Node(name, kind));
+			m_ids.insert(std::make_pair(name, result));
+			return result;
+		}
+
+		// Edges between nodes that were not added are ignored
+		void addEdge(const std::string & u, const std::string & v, unsigned weight) {
+			std::map<std::string, unsigned>::iterator uit = m_ids.find(u);
+			std::map<std::string, unsigned>::iterator vit = m_ids.find(v);
+			if ((uit == m_ids.end()) || (vit == m_ids.end()) ||
+					(uit->second == vit->second)) {
+				return;
+			}
+			Node & from = m_nodes[uit->second];
+			Node & to = m_nodes[vit->second];
+			from.neighbours[vit->second] += weight;
+			to.neighbours[uit->second] += weight;
+			from.weight += weight;
+			to.weight += weight;
+		}
+
+		void addGraph(const LocalityGraph & graph) {
+			for (LocalityGraph::NodeId u = 0; u < graph.getNodeCount(); u++) {
+				for (unsigned edge = graph.getEdgesBegin(u); edge < graph.getEdgesEnd(u);
+						edge++) {
+					addEdge(graph.getName(u), graph.getName(graph.getTarget(edge)),
+							graph.getWeight(edge));
+				}
+			}
+		}
+
+		void partition(unsigned groupCount, unsigned imbalance) {
+			if (groupCount == 0) {
+				groupCount = 1;
+			}
+			m_groupWeights.assign(groupCount, 0);
+			unsigned long total = 0;
+			for (unsigned idx = 0; idx < m_nodes.size(); idx++) {
+				total += m_nodes[idx].weight;
+			}
+			unsigned long share = (total + groupCount - 1) / groupCount;
+			m_capacity = share + share * imbalance / 100;
+			grow();
+			for (unsigned pass = 0; (pass < RefinePassCount) && refine(); pass++) {
+			}
+		}
+
+		// Weight of the edges between groups
+		unsigned long getCutWeight() const {
+			unsigned long result = 0;
+			for (unsigned idx = 0; idx < m_nodes.size(); idx++) {
+				const Node & node = m_nodes[idx];
+				for (std::map<unsigned, unsigned>::const_iterator it = node.neighbours.begin(),
+										ie = node.neighbours.end();
+						it != ie; it++) {
+					if ((it->first > idx) && (m_nodes[it->first].group != node.group)) {
+						result += it->second;
+					}
+				}
+			}
+			return result;
+		}
+
+		// Placement file: One "function|global <name> <group>" per line
+		void print(llvm::raw_ostream & O) const {
+			O << "# groups " << m_groupWeights.size() << " cut " << getCutWeight() << "\n";
+			for (unsigned group = 0; group < m_groupWeights.size(); group++) {
+				O << "# group " << group << " weight " << m_groupWeights[group] << "\n";
+			}
+			for (unsigned idx = 0; idx < m_nodes.size(); idx++) {
+				const Node & node = m_nodes[idx];
+				O << ((node.kind == Node_Function) ? "function " : "global ") <<
+						node.name << " " << node.group << "\n";
+			}
+		}
+	};
+}
+#endif // LOCALITY_PARTITIONER_H
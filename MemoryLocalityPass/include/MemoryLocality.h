@@ -7,8 +7,40 @@
 #include <vector>
 
 #include <llvm/Pass.h>
+#include <llvm/Support/DataTypes.h>
+
+#include <LocalityGraph.h>
+
+namespace llvm {
+	class FunctionValueIndex;
+	class IndirectCallIndex;
+}
 
 namespace MemoryLocality {
+	extern int MemoryLocalityIndirectCallFanout;
+	extern int MemoryLocalityNarrowVirtualCalls;
+	extern int MemoryLocalityPointerSourceTemplates;
+	extern int MemoryLocalityPrintIsolatedFunctions;
+	extern int MemoryLocalityPrintCondensed;
+	extern int MemoryLocalityPrintHeaviestEdges;
+	extern int MemoryLocalityPrintEdgeWeights;
+	extern int MemoryLocalityThreadRoots;
+	extern int MemoryLocalityExportedRoots;
+	extern const char * MemoryLocalityRoots;
+	extern int MemoryLocalityContextDepth;
+	extern int MemoryLocalityContextKind;
+	extern int MemoryLocalityProgressInterval;
+	extern const char * MemoryLocalityCheckpointFile;
+	extern int MemoryLocalityCheckpointInterval;
+	extern int MemoryLocalityResume;
+
+	typedef enum {
+		// Last MemoryLocalityContextDepth call sites
+		Context_CallString,
+		// Sources of the arguments
+		Context_Arguments
+	} ContextKind;
+
 	typedef enum {
 		PointerSource_Primitive,
 		PointerSource_Local,
@@ -34,42 +66,120 @@ namespace MemoryLocality {
 		}
 	};
 
-	typedef std::map<std::string, std::set<std::string> > EdgesType;
-
 	struct WorkQueueItem {
 		std::set<llvm::Function *> callers;
+		// Innermost call site last. Kept only with a limited context depth.
+		std::vector<llvm::CallInst *> callString;
 		llvm::Function * function;
 		llvm::CallInst * callInst;
 		std::vector<PointerSource> argumentSources;
+		// One of several candidates of an indirect call: The result is
+		// joined with the other candidates'
+		bool isJoinResult;
+
+		WorkQueueItem() : function(0), callInst(0), isJoinResult(false) {}
 
 		void clear() {
 			callers.clear();
+			callString.clear();
 			function = 0;
 			callInst = 0;
 			argumentSources.clear();
+			isJoinResult = false;
 		}
 	};
 	typedef std::vector<WorkQueueItem> WorkQueueType;
 
 	class LocalityFunctionVisitor;
+	class PointerSourceTemplate;
+
+	// Contexts of a function that are merged into one. Arguments and
+	// return value are the join over all merged contexts.
+	struct ContextSummary {
+		std::vector<PointerSource> argumentSources;
+		PointerSource returnValueSource;
+		bool isVisited;
+
+		ContextSummary() : isVisited(false) {}
+	};
+
+	// Analysis state of one root. Roots are analysed in turns, one
+	// instruction each.
+	struct LocalityRoot {
+		llvm::Function * function;
+		std::vector<LocalityFunctionVisitor *> visitorsStack;
+		std::map<llvm::CallInst*, PointerSource> callResults;
+		// Merged contexts, by getContextKey. Per root, since a context is
+		// only covered by what was analysed from the same root.
+		std::map<std::string, ContextSummary> contexts;
+		// Edges found from this root
+		LocalityGraph graph;
+
+		LocalityRoot(llvm::Function * function) : function(function) {}
+	};
 	class MemoryLocality : public llvm::ModulePass {
 	protected:
-		EdgesType edges;
-		std::vector<LocalityFunctionVisitor *> localityVisitorsStack;
-		std::map<llvm::CallInst*, PointerSource> callResults;
+		LocalityGraph graph;
+		// Function to the globals it accesses. Not printed.
+		LocalityGraph globalGraph;
+		std::vector<LocalityRoot *> roots;
+		// The root being stepped
+		LocalityRoot * currentRoot;
+		// Number of visitors of each function, over all roots' stacks
+		std::map<llvm::Function *, unsigned> activeFunctions;
+		// Materialized by this pass. Dematerialized when no root visits
+		// them anymore.
+		std::set<llvm::Function *> materializedFunctions;
+		llvm::IndirectCallIndex * indirectCallIndex;
+		// Built once per function, shared by all its contexts
+		std::map<llvm::Function *, PointerSourceTemplate *> pointerSourceTemplates;
+		// Shared by the evaluator caches of all of a function's contexts
+		std::map<llvm::Function *, llvm::FunctionValueIndex *> valueIndices;
+		// Progress, kept across checkpoints
+		uint64_t instructionCount;
+		uint64_t visitCount;
+		// Accesses that added weight to an edge, not distinct edges
+		uint64_t accessCount;
+		uint64_t finishedCallCount;
+		// Visits made under the finished calls
+		uint64_t finishedCallVisits;
+		std::map<llvm::Function *, unsigned> callSiteCounts;
+		// Written to checkpoints. Only computed when checkpointing.
+		uint64_t moduleFingerprint;
 
 		llvm::Function * getRoot(llvm::Module &M) const;
+		void findRoots(llvm::Module &M, std::vector<llvm::Function *> & functions) const;
+		void addRoot(llvm::Function * F);
 		void addEdge(const std::string & u, const std::string & v);
 		void workOnItem(WorkQueueItem & item);
 		void visit();
 		void callAdded(WorkQueueItem & item);
+		LocalityFunctionVisitor * createVisitor(WorkQueueItem & item, LocalityRoot * root);
+		unsigned getCallSiteCount(llvm::Function * F);
+		void reportProgress();
+		bool writeCheckpoint(const char * path);
+		bool readCheckpoint(llvm::Module &M, const char * path);
+		void indirectCallAdded(LocalityFunctionVisitor & visitor);
+		void joinCallResult(llvm::CallInst * callInst, const PointerSource & source);
+		void setCallResult(const WorkQueueItem & item, const PointerSource & source);
+		std::string getContextKey(const WorkQueueItem & item);
+		ContextSummary * getContext(WorkQueueItem & item, LocalityRoot * root,
+				bool & isCovered);
+		void dematerialize(LocalityFunctionVisitor & visitor);
+		void dematerialize(llvm::Function * F);
+		PointerSourceTemplate * getPointerSourceTemplate(llvm::Function * F);
+		llvm::FunctionValueIndex * getValueIndex(llvm::Function * F);
 	public:
 		static char ID;
-		MemoryLocality() : llvm::ModulePass(ID) {};
-		virtual ~MemoryLocality() {};
+		MemoryLocality() : llvm::ModulePass(ID), currentRoot(0), indirectCallIndex(0),
+				instructionCount(0), visitCount(0), accessCount(0),
+				finishedCallCount(0), finishedCallVisits(0), moduleFingerprint(0) {};
+		virtual ~MemoryLocality();
 		virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
 		virtual bool runOnModule(llvm::Module &M);
 		virtual void print(llvm::raw_ostream &O, const llvm::Module *M) const;
+		const LocalityGraph & getGraph() const { return graph; }
+		const LocalityGraph & getGlobalGraph() const { return globalGraph; }
 	};
 }
 #endif // MEMORY_LOCALITY_H
@@ -0,0 +1,133 @@
+#ifndef POINTER_SOURCE_TEMPLATE_H
+#define POINTER_SOURCE_TEMPLATE_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+
+#include <Dataflow.h>
+
+namespace MemoryLocality {
+	// Per underlying object, the root of the pointer last stored to it.
+	// Objects missing from a state are not stored to on that path
+	// (NotStored): They still hold whatever they held on entry, so they
+	// join with any root to top. Objects stored different roots on
+	// different paths map to 0 (top). Bottom is only the state of blocks
+	// not reached yet.
+	struct StoredRoots {
+		typedef std::map<const llvm::Value *, llvm::Value *> RootsType;
+		bool isBottom;
+		RootsType roots;
+
+		StoredRoots(bool a_isBottom = false) : isBottom(a_isBottom) {}
+	};
+
+	// Per function. Maps each pointer to the value its source is taken
+	// from: An argument, global, alloca, call or null.
+	// Sources of arguments and call results depend on the call context, so
+	// the template is instantiated by evaluating the root in that context.
+	// Flow-sensitive forward dataflow over StoredRoots: A load of an
+	// alloca whose address is not captured takes the root last stored to
+	// all of it on all paths. Calls clobber every object but those allocas, and
+	// memory intrinsics their destination. Other loads are left to MemDep.
+	class PointerSourceTemplate {
+	public:
+		typedef StoredRoots LatticeType;
+	protected:
+		std::map<const llvm::Value *, llvm::Value *> m_roots;
+		// Allocas whose address may be captured. Calls may store to them.
+		std::set<const llvm::Value *> m_escaped;
+		// A root changed during the last solve
+		bool m_isChanged;
+
+		llvm::Value * computeRoot(llvm::Instruction & I, const StoredRoots & state) const;
+		llvm::Value * computeLoadRoot(llvm::LoadInst & LI, const StoredRoots & state) const;
+	public:
+		PointerSourceTemplate() : m_isChanged(false) {}
+		void build(llvm::Function & F);
+		// 0 if not found
+		llvm::Value * getRoot(llvm::Value * value) const;
+
+		// LatticeDataflow problem
+		LatticeType getBoundary(llvm::Function & F) { return StoredRoots(); }
+		void transfer(llvm::BasicBlock & BB, const LatticeType & in, LatticeType & out);
+	};
+}
+
+namespace llvm {
+	template <> struct LatticeTraits<MemoryLocality::StoredRoots> {
+		typedef MemoryLocality::StoredRoots::RootsType RootsType;
+		// Only blocks not reached are bottom
+		static const bool isSparse = true;
+
+		static MemoryLocality::StoredRoots bottom() { return MemoryLocality::StoredRoots(true); }
+
+		static bool join(MemoryLocality::StoredRoots & result,
+				const MemoryLocality::StoredRoots & other) {
+			if (other.isBottom) {
+				return false;
+			}
+			if (result.isBottom) {
+				result = other;
+				return true;
+			}
+			bool isChanged = false;
+			// Stored on one side only: The other side is NotStored
+			for (RootsType::iterator it = result.roots.begin(), ie = result.roots.end();
+					it != ie; it++) {
+				if (it->second && !other.roots.count(it->first)) {
+					it->second = 0;
+					isChanged = true;
+				}
+			}
+			for (RootsType::const_iterator it = other.roots.begin(), ie = other.roots.end();
+					it != ie; it++) {
+				std::pair<RootsType::iterator, bool> inserted =
+						result.roots.insert(std::make_pair(it->first, (llvm::Value *)0));
+				if (inserted.second) {
+					isChanged = true;
+				} else if (inserted.first->second && (inserted.first->second != it->second)) {
+					inserted.first->second = 0;
+					isChanged = true;
+				}
+			}
+			return isChanged;
+		}
+
+		// Per object, NotStored and each root are below top only
+		static bool leq(const MemoryLocality::StoredRoots & a,
+				const MemoryLocality::StoredRoots & b) {
+			if (a.isBottom) {
+				return true;
+			}
+			if (b.isBottom) {
+				return false;
+			}
+			for (RootsType::const_iterator it = a.roots.begin(), ie = a.roots.end();
+					it != ie; it++) {
+				RootsType::const_iterator found = b.roots.find(it->first);
+				if ((found == b.roots.end()) ||
+						(found->second && (found->second != it->second))) {
+					return false;
+				}
+			}
+			for (RootsType::const_iterator it = b.roots.begin(), ie = b.roots.end();
+					it != ie; it++) {
+				if (it->second && !a.roots.count(it->first)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Each object goes up at most twice
+		static bool widen(MemoryLocality::StoredRoots & result,
+				const MemoryLocality::StoredRoots & other) {
+			return join(result, other);
+		}
+	};
+}
+#endif // POINTER_SOURCE_TEMPLATE_H
@@ -0,0 +1,227 @@
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+
+#include <LocalityCheckpoint.h>
+
+namespace MemoryLocality {
+
+// FNV-1a: Stable across processes, unlike llvm::hash_value
+static void addToFingerprint(uint64_t & fingerprint, const char * bytes, size_t size) {
+	for (size_t idx = 0; idx < size; idx++) {
+		fingerprint ^= (unsigned char)bytes[idx];
+		fingerprint *= 1099511628211ULL;
+	}
+}
+
+uint64_t getModuleFingerprint(llvm::Module & M) {
+	uint64_t fingerprint = 14695981039346656037ULL;
+	for (llvm::Module::iterator fit = M.begin(), fie = M.end(); fit != fie; fit++) {
+		llvm::Function * F = &*fit;
+		bool isMaterialized = false;
+		if (F->isMaterializable()) {
+			std::string error;
+			if (F->Materialize(&error)) {
+				continue;
+			}
+			isMaterialized = true;
+		}
+		unsigned count = 0;
+		for (llvm::Function::iterator bit = F->begin(), bie = F->end();
+				bit != bie; bit++) {
+			count += bit->size();
+		}
+		if (isMaterialized) {
+			F->Dematerialize();
+		}
+		std::string name = F->getName().str();
+		addToFingerprint(fingerprint, name.c_str(), name.size() + 1);
+		char bytes[4];
+		for (unsigned idx = 0; idx < 4; idx++) {
+			bytes[idx] = (count >> (8 * idx)) & 0xff;
+		}
+		addToFingerprint(fingerprint, bytes, 4);
+	}
+	return fingerprint;
+}
+
+void CheckpointWriter::writeWord(unsigned word) {
+	char bytes[4];
+	for (unsigned idx = 0; idx < 4; idx++) {
+		bytes[idx] = (word >> (8 * idx)) & 0xff;
+	}
+	O.write(bytes, 4);
+}
+
+void CheckpointWriter::writeCount(uint64_t count) {
+	writeWord(count & 0xffffffff);
+	writeWord(count >> 32);
+}
+
+void CheckpointWriter::writeString(const std::string & string) {
+	writeWord(string.size());
+	O << string;
+}
+
+void CheckpointWriter::writeFunction(const llvm::Function * F) {
+	writeString(F ? F->getName().str() : std::string());
+}
+
+void CheckpointWriter::writeInstruction(const llvm::Instruction * I) {
+	if (!I) {
+		writeFunction(0);
+		return;
+	}
+	const llvm::Function * F = I->getParent()->getParent();
+	std::map<const llvm::Instruction *, unsigned> & positions = m_positions[F];
+	if (positions.empty()) {
+		unsigned position = 0;
+		for (llvm::Function::const_iterator bit = F->begin(), bie = F->end();
+				bit != bie; bit++) {
+			for (llvm::BasicBlock::const_iterator it = bit->begin(), ie = bit->end();
+					it != ie; it++) {
+				positions[&*it] = position++;
+			}
+		}
+	}
+	writeFunction(F);
+	writeWord(positions[I]);
+}
+
+void CheckpointWriter::writeSource(const PointerSource & source) {
+	writeWord(source.type);
+	writeString(source.name);
+	if (!source.argument) {
+		writeFunction(0);
+		return;
+	}
+	writeFunction(source.argument->getParent());
+	writeWord(source.argument->getArgNo());
+}
+
+void CheckpointWriter::writeGraph(const LocalityGraph & graph) {
+	std::string data;
+	llvm::raw_string_ostream stream(data);
+	graph.writeBinary(stream);
+	writeString(stream.str());
+}
+
+bool CheckpointReader::fail() {
+	m_isValid = false;
+	return false;
+}
+
+bool CheckpointReader::readWord(unsigned & word) {
+	if (!m_isValid || (m_data.size() < 4)) {
+		return fail();
+	}
+	word = 0;
+	for (unsigned idx = 0; idx < 4; idx++) {
+		word |= ((unsigned)(unsigned char)m_data[idx]) << (8 * idx);
+	}
+	m_data = m_data.substr(4);
+	return true;
+}
+
+bool CheckpointReader::readCount(uint64_t & count) {
+	unsigned low, high;
+	if (!readWord(low) || !readWord(high)) {
+		return false;
+	}
+	count = ((uint64_t)high << 32) | low;
+	return true;
+}
+
+bool CheckpointReader::readString(std::string & string) {
+	unsigned length;
+	if (!readWord(length) || (m_data.size() < length)) {
+		return fail();
+	}
+	string = m_data.substr(0, length).str();
+	m_data = m_data.substr(length);
+	return true;
+}
+
+bool CheckpointReader::readFunction(llvm::Function *& F) {
+	std::string name;
+	if (!readString(name)) {
+		return false;
+	}
+	F = 0;
+	if (name.empty()) {
+		return true;
+	}
+	F = M.getFunction(name);
+	return F ? true : fail();
+}
+
+bool CheckpointReader::readInstruction(llvm::Instruction *& I) {
+	llvm::Function * F;
+	unsigned position;
+	I = 0;
+	if (!readFunction(F)) {
+		return false;
+	}
+	if (!F) {
+		return true;
+	}
+	if (!readWord(position)) {
+		return false;
+	}
+	std::vector<llvm::Instruction *> & instructions = m_instructions[F];
+	if (instructions.empty()) {
+		if (F->isMaterializable()) {
+			std::string error;
+			if (F->Materialize(&error)) {
+				return fail();
+			}
+			materialized.insert(F);
+		}
+		for (llvm::Function::iterator bit = F->begin(), bie = F->end();
+				bit != bie; bit++) {
+			for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+					it != ie; it++) {
+				instructions.push_back(&*it);
+			}
+		}
+	}
+	if (position >= instructions.size()) {
+		return fail();
+	}
+	I = instructions[position];
+	return true;
+}
+
+bool CheckpointReader::readSource(PointerSource & source) {
+	unsigned type;
+	llvm::Function * F;
+	if (!readWord(type) || (type > PointerSource_Unknown) ||
+			!readString(source.name) || !readFunction(F)) {
+		return fail();
+	}
+	source.type = (PointerSourceType)type;
+	source.argument = 0;
+	if (!F) {
+		return true;
+	}
+	unsigned argNo;
+	if (!readWord(argNo) || (argNo >= F->arg_size())) {
+		return fail();
+	}
+	llvm::Function::arg_iterator it = F->arg_begin();
+	for (; argNo > 0; argNo--) {
+		it++;
+	}
+	source.argument = &*it;
+	return true;
+}
+
+bool CheckpointReader::readGraph(LocalityGraph & graph) {
+	std::string data;
+	if (!readString(data)) {
+		return false;
+	}
+	return graph.readBinary(data) ? true : fail();
+}
+
+}
@@ -1,15 +1,27 @@
+#include <algorithm>
+#include <cstdio>
+
 #include <llvm/Analysis/CallGraph.h>
 #include <llvm/Analysis/MemoryDependenceAnalysis.h>
 #include <llvm/Analysis/PHITransAddr.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/system_error.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <dsa/AllocatorIdentification.h>
 
 //#include <MemoryDependenceAnalysis.h>
+#include <IndirectCallIndex.h>
+#include <LocalityCheckpoint.h>
 #include <MemoryLocality.h>
+#include <PointerSourceTemplate.h>
 #include <ValueVisitor.h>
 
 #define PHI_DEPTH_WATERMARK 10
@@ -112,6 +124,85 @@ public:
 }
 namespace MemoryLocality {
 
+// If non-zero, indirect calls with up to this many candidate callees are
+// followed into all of them
+int MemoryLocalityIndirectCallFanout = 0;
+// Narrow calls through vtable slots to the functions in that slot
+int MemoryLocalityNarrowVirtualCalls = 0;
+// Evaluate pointers through a per-function PointerSourceTemplate, instead of
+// MemDep queries in every context. MemDep is still used for the pointers the
+// template can't resolve.
+int MemoryLocalityPointerSourceTemplates = 0;
+// Also print functions without locality edges
+int MemoryLocalityPrintIsolatedFunctions = 1;
+// Print one node per strongly connected component. Edges are then not
+// labelled with the roots they were found from.
+int MemoryLocalityPrintCondensed = 0;
+// If non-zero, print only this many of the heaviest edges
+int MemoryLocalityPrintHeaviestEdges = 0;
+// Print edge weights as DOT weight attributes
+int MemoryLocalityPrintEdgeWeights = 0;
+// Also analyse from functions passed to pthread_create, thrd_create or
+// signal, and std::thread bodies
+int MemoryLocalityThreadRoots = 0;
+// Also analyse from every externally visible function
+int MemoryLocalityExportedRoots = 0;
+// Comma separated names of more functions to analyse from
+const char * MemoryLocalityRoots = 0;
+
+// The roots can also be chosen on the command line of opt or memanalysis.
+// These add to the tunables above.
+static llvm::cl::opt<bool> ThreadRootsOption("memlocality-thread-roots",
+		llvm::cl::desc("Also analyse from thread entry points"));
+static llvm::cl::opt<bool> ExportedRootsOption("memlocality-exported-roots",
+		llvm::cl::desc("Also analyse from every externally visible function"));
+static llvm::cl::list<std::string> RootsOption("memlocality-roots",
+		llvm::cl::desc("More functions to analyse from"),
+		llvm::cl::value_desc("name,..."), llvm::cl::CommaSeparated);
+// Call sites kept in a context. Contexts that agree on the last ones are
+// merged. Negative: Every call path is its own context.
+int MemoryLocalityContextDepth = -1;
+// ContextKind. Argument contexts ignore the depth.
+int MemoryLocalityContextKind = Context_CallString;
+// Instructions between progress reports on stderr. 0 disables them.
+int MemoryLocalityProgressInterval = 0;
+// If set, the work stacks, call results and edges are saved here
+// periodically
+const char * MemoryLocalityCheckpointFile = 0;
+// Instructions between checkpoints
+int MemoryLocalityCheckpointInterval = 1000000;
+// Start from MemoryLocalityCheckpointFile, if it can be read
+int MemoryLocalityResume = 0;
+
+#define CHECKPOINT_VERSION 2
+
+struct EntryArgument {
+	const char * function;
+	unsigned argument;
+};
+
+// Functions taking a function that runs in another thread, or
+// asynchronously
+static const EntryArgument entryArguments[] = {
+	{ "pthread_create", 2 },
+	{ "thrd_create", 1 },
+	{ "signal", 1 },
+	{ 0, 0 }
+};
+
+// Sources that disagree join to Unknown. Returns true if result changed.
+static bool joinPointerSource(PointerSource & result, const PointerSource & source) {
+	if ((result.type == source.type) && (result.name == source.name) &&
+			(result.argument == source.argument)) {
+		return false;
+	}
+	if (result.type == PointerSource_Unknown && result.name.empty() && !result.argument) {
+		return false;
+	}
+	result.clear();
+	return true;
+}
+
 class MemoryDependenceAnalysis : public llvm::MemoryDependenceAnalysis {
 public:
 	static char ID;
@@ -129,7 +220,12 @@ static llvm::RegisterPass<MemoryDependenceAnalysis> _W(
 		"MemoryDependenceAnalysis with forced basicaa",
 		false, false);
 
-struct PointerSourceEvaluator : public llvm::ValueVisitor<PointerSourceEvaluator> {
+typedef llvm::DenseValueCache<PointerSource> PointerSourceCache;
+
+// Caches results per context. Results that depend on call results not
+// known yet, or cut short by the phi watermark, are not cached.
+struct PointerSourceEvaluator : public llvm::ValueVisitor<PointerSourceEvaluator, void,
+		PointerSourceCache> {
 	PointerSource pointerSource;
 	std::vector<PointerSource> & arguments;
 	MemoryDependenceAnalysis * mda;
@@ -138,13 +234,27 @@ struct PointerSourceEvaluator : public llvm::ValueVisitor<PointerSourceEvaluator
 	llvm::AllocIdentify * AI;
 	std::map<llvm::CallInst*, PointerSource> & callResults;
 	int phidepth;
+	bool isStable;
 
-	PointerSourceEvaluator(std::vector<PointerSource> & arguments, MemoryDependenceAnalysis * mda, llvm::AliasAnalysis * AA, llvm::DataLayout * DL, llvm::AllocIdentify * AI, std::map<llvm::CallInst*, PointerSource> & callResults) :
-			llvm::ValueVisitor<PointerSourceEvaluator>(), arguments(arguments), mda(mda), AA(AA), DL(DL), AI(AI), callResults(callResults), phidepth(0) {}
+	PointerSourceEvaluator(std::vector<PointerSource> & arguments, MemoryDependenceAnalysis * mda, llvm::AliasAnalysis * AA, llvm::DataLayout * DL, llvm::AllocIdentify * AI, std::map<llvm::CallInst*, PointerSource> & callResults, const llvm::FunctionValueIndex * valueIndex) :
+			llvm::ValueVisitor<PointerSourceEvaluator, void, PointerSourceCache>(
+					PointerSourceCache(valueIndex)),
+			arguments(arguments), mda(mda), AA(AA), DL(DL), AI(AI), callResults(callResults), phidepth(0), isStable(true) {}
 	~PointerSourceEvaluator() {}
 	void clear() {
 		pointerSource.clear();
 		arguments.clear();
+		m_cache.clear();
+	}
+	void evaluate(llvm::Value * value) {
+		isStable = true;
+		visit(value);
+		if (isStable) {
+			m_cache.insert(value, pointerSource);
+		}
+	}
+	void visitCached(llvm::Value & value, const PointerSource & cached) {
+		pointerSource = cached;
 	}
 	void visitArgument(llvm::Argument &A) {
 		if (arguments.empty()) {
@@ -182,11 +292,26 @@ struct PointerSourceEvaluator : public llvm::ValueVisitor<PointerSourceEvaluator
 			pointerSource.type = PointerSource_Function;
 			if (AI->isAllocator(calledFunction->getName())) {
 				pointerSource.name = CI.getParent()->getParent()->getName();
+				return;
+			}
+			std::map<llvm::CallInst*, PointerSource>::iterator it =
+					callResults.find(&CI);
+			if (it != callResults.end()) {
+				pointerSource = it->second;
 			} else {
-				pointerSource = callResults[&CI];
+				pointerSource.clear();
+				isStable = false;
 			}
 		} else {
-			pointerSource.type = PointerSource_Unknown;
+			// Joined over the candidate callees, if resolved
+			std::map<llvm::CallInst*, PointerSource>::iterator it =
+					callResults.find(&CI);
+			if (it != callResults.end()) {
+				pointerSource = it->second;
+			} else {
+				pointerSource.type = PointerSource_Unknown;
+				isStable = false;
+			}
 		}
 	}
 
@@ -280,15 +405,16 @@ struct PointerSourceEvaluator : public llvm::ValueVisitor<PointerSourceEvaluator
 
 	void visitPHINode(llvm::PHINode &I) {
 		if (phidepth >= PHI_DEPTH_WATERMARK) {
+			isStable = false;
 			return;
 		}
 		++phidepth;
 		pointerSource.clear();
 		for (unsigned idx = 0; idx < I.getNumIncomingValues(); idx++) {
-			llvm::Value * value = I.getIncomingValue(idx);
 			visit(I.getIncomingValue(idx));
 			// TODO Join accross all phis?
 			if (pointerSource.type != PointerSource_Unknown) {
+				--phidepth;
 				return;
 			}
 		}
@@ -325,7 +451,20 @@ struct LocalityFunctionVisitor : public llvm::InstVisitor<LocalityFunctionVisito
 	WorkQueueItem newWorkItem;
 	PointerSource returnValueSource;
 	std::set<std::string> outgoingEdges;
+	// Calls from this function whose results are in callResults
+	std::vector<llvm::CallInst *> issuedCalls;
+	// Callees of an indirect call in newWorkItem
+	std::vector<llvm::Function *> calleeCandidates;
+	llvm::IndirectCallIndex * indirectCallIndex;
+	PointerSourceTemplate * pointerSourceTemplate;
+	// Merged context this visit is for, if any
+	ContextSummary * context;
 	llvm::FunctionInstructionIterator iterator;
+	// Instructions visited, and call sites among them
+	unsigned position;
+	unsigned callSitesPassed;
+	// MemoryLocality::visitCount when this visit started
+	uint64_t visitsAtStart;
 	llvm::Instruction * instruction;
 	bool isModified;
 	bool isCall;
@@ -334,16 +473,27 @@ struct LocalityFunctionVisitor : public llvm::InstVisitor<LocalityFunctionVisito
 	LocalityFunctionVisitor(
 			WorkQueueItem & item,
 			MemoryDependenceAnalysis * mda, llvm::AliasAnalysis * AA, llvm::DataLayout * DL, llvm::AllocIdentify * AI,
-			std::map<llvm::CallInst*, PointerSource> &callResults) : 
-					visitor(item.argumentSources, mda, AA, DL, AI, callResults),
+			std::map<llvm::CallInst*, PointerSource> &callResults,
+			llvm::IndirectCallIndex * indirectCallIndex,
+			PointerSourceTemplate * pointerSourceTemplate,
+			const llvm::FunctionValueIndex * valueIndex) : 
+					// Bound to the copy: item may not outlive the visitor
+					visitor(workItem.argumentSources, mda, AA, DL, AI, callResults, valueIndex),
 					workItem(item),
-					iterator(*item.function) {}
+					indirectCallIndex(indirectCallIndex),
+					pointerSourceTemplate(pointerSourceTemplate),
+					context(0),
+					iterator(*item.function),
+					position(0),
+					callSitesPassed(0),
+					visitsAtStart(0) {}
 
 	PointerSource & evaluate(llvm::Value * value) {
-		// TODO Add caching
 		visitor.pointerSource.clear();
 		if (value->getType()->isPointerTy()) {
-			visitor.visit(value);
+			llvm::Value * root = pointerSourceTemplate ?
+					pointerSourceTemplate->getRoot(value) : 0;
+			visitor.evaluate(root ? root : value);
 		} else {
 			visitor.pointerSource.type = PointerSource_Primitive;
 		}
@@ -371,22 +521,32 @@ struct LocalityFunctionVisitor : public llvm::InstVisitor<LocalityFunctionVisito
 
 	void visitCallInst(llvm::CallInst &CI) {
 		llvm::Function * calledFunction = CI.getCalledFunction();
-		//assert(calledFunction && "Indirect function calls are not yet supported");
-		if (!calledFunction) {
+		callSitesPassed++;
+		calleeCandidates.clear();
+		if (!calledFunction && (!indirectCallIndex ||
+				!indirectCallIndex->getCallees(CI, calleeCandidates,
+						MemoryLocalityIndirectCallFanout))) {
 			addEdge("Unknown locality (INACCURACY, Indirect function call)");
 			return;
 		}
-		// Found this function. Add it to the work queue, with all its
-		// arguments
+		// Found this function (or its candidates). Add it to the work
+		// queue, with all its arguments
 		// 1. Populate arguments
 		newWorkItem.clear();
 		newWorkItem.callInst = &CI;
 		newWorkItem.function = calledFunction;
 		newWorkItem.callers = workItem.callers;
-		if (!newWorkItem.callers.insert(calledFunction).second) {
+		if (calledFunction && !newWorkItem.callers.insert(calledFunction).second) {
 			addEdge("Unknown locality (INACCURACY, Recursion)");
 			return;
 		}
+		if (MemoryLocalityContextDepth > 0) {
+			newWorkItem.callString = workItem.callString;
+			newWorkItem.callString.push_back(&CI);
+			if (newWorkItem.callString.size() > (unsigned)MemoryLocalityContextDepth) {
+				newWorkItem.callString.erase(newWorkItem.callString.begin());
+			}
+		}
 		for (unsigned idx = 0; idx < CI.getNumArgOperands(); idx++) {
 			llvm::Value * value = CI.getArgOperand(idx);
 			PointerSource & pointerSource = evaluate(value);
@@ -398,6 +558,7 @@ struct LocalityFunctionVisitor : public llvm::InstVisitor<LocalityFunctionVisito
 		}
 		// 2. Add to work queue
 		isCall = true;
+		issuedCalls.push_back(&CI);
 	}
 
 	void visitReturnInst(llvm::ReturnInst & RI) {
@@ -410,14 +571,27 @@ struct LocalityFunctionVisitor : public llvm::InstVisitor<LocalityFunctionVisito
 
 	void start() {
 		iterator = iterator.begin();
+		position = 0;
 		isFinished = iterator.atEnd();
 	}
 
+	// Continues after the first count instructions, without visiting them.
+	// False if there are no more instructions.
+	bool skip(unsigned count) {
+		start();
+		for (; (count > 0) && !isFinished; count--) {
+			position++;
+			isFinished = (++iterator).atEnd();
+		}
+		return !isFinished;
+	}
+
 	void visitNext() {
 		isModified = false;
 		isCall = false;
 		instruction = *iterator;
 		visit(instruction);
+		position++;
 		isFinished = (++iterator).atEnd();
 	}
 };
@@ -447,25 +621,149 @@ bool MemoryLocality::runOnModule(llvm::Module &M) {
 	//const llvm::PassInfo * PI = lookupPassInfo(llvm::StringRef("basicaa"));
 	//printAAs(getResolver(), PI);
 
+	llvm::Function * main = getRoot(M);
+	assert(main && "Could not find root function");
+	if (MemoryLocalityIndirectCallFanout > 0) {
+		indirectCallIndex = new llvm::IndirectCallIndex();
+		indirectCallIndex->build(M, MemoryLocalityNarrowVirtualCalls);
+	}
+	if (MemoryLocalityCheckpointFile) {
+		moduleFingerprint = getModuleFingerprint(M);
+	}
+	bool isResumed = MemoryLocalityResume && MemoryLocalityCheckpointFile &&
+			readCheckpoint(M, MemoryLocalityCheckpointFile);
+	if (!isResumed) {
+		addRoot(main);
+		std::vector<llvm::Function *> functions;
+		findRoots(M, functions);
+		for (std::vector<llvm::Function *>::iterator it = functions.begin(),
+								ie = functions.end();
+				it != ie; it++) {
+			if (*it != main) {
+				addRoot(*it);
+			}
+		}
+	}
+	// Round robin, one instruction per root
+	bool isActive = true;
+	while (isActive) {
+		isActive = false;
+		for (std::vector<LocalityRoot *>::iterator it = roots.begin(),
+								ie = roots.end();
+				it != ie; it++) {
+			currentRoot = *it;
+			if (currentRoot->visitorsStack.empty()) {
+				continue;
+			}
+			visit();
+			isActive = true;
+			if ((MemoryLocalityProgressInterval > 0) &&
+					(instructionCount % MemoryLocalityProgressInterval == 0)) {
+				reportProgress();
+			}
+			if (MemoryLocalityCheckpointFile && (MemoryLocalityCheckpointInterval > 0) &&
+					(instructionCount % MemoryLocalityCheckpointInterval == 0)) {
+				writeCheckpoint(MemoryLocalityCheckpointFile);
+			}
+		}
+	}
+	currentRoot = 0;
+	graph.finalize();
+	globalGraph.finalize();
+	for (std::vector<LocalityRoot *>::iterator it = roots.begin(), ie = roots.end();
+			it != ie; it++) {
+		(*it)->graph.finalize();
+	}
+	return false;
+}
+
+void MemoryLocality::addRoot(llvm::Function * F) {
 	WorkQueueItem rootItem;
-	rootItem.function = getRoot(M);
-	rootItem.argumentSources.push_back(PointerSource("argc", PointerSource_Global, 0));
-	rootItem.argumentSources.push_back(PointerSource("argv", PointerSource_Global, 0));
-	rootItem.argumentSources.push_back(PointerSource("envp", PointerSource_Global, 0));
-	assert(rootItem.function && "Could not find root function");
-	rootItem.callers.insert(rootItem.function);
+	rootItem.function = F;
+	if (roots.empty()) {
+		rootItem.argumentSources.push_back(PointerSource("argc", PointerSource_Global, 0));
+		rootItem.argumentSources.push_back(PointerSource("argv", PointerSource_Global, 0));
+		rootItem.argumentSources.push_back(PointerSource("envp", PointerSource_Global, 0));
+	} else {
+		// Owned by whoever started the thread, or called the export
+		for (unsigned idx = 0; idx < F->getFunctionType()->getNumParams(); idx++) {
+			rootItem.argumentSources.push_back(PointerSource(
+					F->getName().str() + " argument", PointerSource_Global, 0));
+		}
+	}
+	rootItem.callers.insert(F);
+	currentRoot = new LocalityRoot(F);
+	roots.push_back(currentRoot);
 	callAdded(rootItem);
-	while (!localityVisitorsStack.empty()) {
-		visit();
+}
+
+void MemoryLocality::findRoots(llvm::Module &M,
+		std::vector<llvm::Function *> & functions) const {
+	std::set<llvm::Function *> found;
+	bool isThreadRoots = MemoryLocalityThreadRoots || ThreadRootsOption;
+	bool isExportedRoots = MemoryLocalityExportedRoots || ExportedRootsOption;
+	for (unsigned idx = 0; isThreadRoots && entryArguments[idx].function; idx++) {
+		llvm::Function * F = M.getFunction(entryArguments[idx].function);
+		if (!F) {
+			continue;
+		}
+		unsigned argument = entryArguments[idx].argument;
+		for (llvm::Value::use_iterator it = F->use_begin(), ie = F->use_end();
+				it != ie; it++) {
+			llvm::CallInst * ci = llvm::dyn_cast<llvm::CallInst>(*it);
+			if (!ci || (ci->getCalledFunction() != F) ||
+					(ci->getNumArgOperands() <= argument)) {
+				continue;
+			}
+			llvm::Function * entry = llvm::dyn_cast<llvm::Function>(
+					ci->getArgOperand(argument)->stripPointerCasts());
+			if (entry && found.insert(entry).second) {
+				functions.push_back(entry);
+			}
+		}
+	}
+	llvm::SmallVector<llvm::StringRef, 8> names;
+	if (MemoryLocalityRoots) {
+		llvm::StringRef(MemoryLocalityRoots).split(names, ",", -1, false);
+	}
+	names.append(RootsOption.begin(), RootsOption.end());
+	for (llvm::Module::iterator it = M.begin(), ie = M.end(); it != ie; it++) {
+		llvm::Function * F = &*it;
+		if (F->isDeclaration() && !F->isMaterializable()) {
+			continue;
+		}
+		llvm::StringRef name = F->getName();
+		// libstdc++ runs std::thread bodies from _M_run, through a vtable
+		bool isRoot = isThreadRoots &&
+				(name.startswith("_ZNSt6thread11_State_impl") ||
+				name.startswith("_ZNSt6thread5_Impl")) &&
+				(name.find("_M_run") != llvm::StringRef::npos);
+		isRoot |= isExportedRoots && !F->hasLocalLinkage();
+		for (unsigned idx = 0; !isRoot && (idx < names.size()); idx++) {
+			isRoot = (names[idx].trim() == name);
+		}
+		if (isRoot && found.insert(F).second) {
+			functions.push_back(F);
+		}
+	}
+	for (unsigned idx = 0; idx < functions.size(); idx++) {
+		if (functions[idx]->isDeclaration() && !functions[idx]->isMaterializable()) {
+			functions.erase(functions.begin() + idx);
+			idx--;
+		}
 	}
-	return false;
 }
 
 void MemoryLocality::visit() {
-	LocalityFunctionVisitor * visitor = localityVisitorsStack.back();
+	LocalityFunctionVisitor * visitor = currentRoot->visitorsStack.back();
 	visitor->visitNext();
+	instructionCount++;
 	if (visitor->isCall) {
-		callAdded(visitor->newWorkItem);
+		if (visitor->calleeCandidates.empty()) {
+			callAdded(visitor->newWorkItem);
+		} else {
+			indirectCallAdded(*visitor);
+		}
 	}
 	if (visitor->isModified) {
 		PointerSource & source = visitor->source;
@@ -476,6 +774,8 @@ void MemoryLocality::visit() {
 				break;
 			case PointerSource_Global:
 				//addEdge(visitor->workItem.function->getName(), "Global objects");
+				globalGraph.addEdge(visitor->workItem.function->getName(), source.name);
+				accessCount++;
 				break;
 			case PointerSource_Argument:
 				//addEdge(visitor->workItem.function->getName(), "Unevaluated argument (ERROR)");
@@ -490,30 +790,543 @@ void MemoryLocality::visit() {
 		}
 	}
 	if (visitor->isFinished) {
-		callResults[visitor->workItem.callInst] = visitor->returnValueSource;
-		localityVisitorsStack.pop_back();
+		if (visitor->workItem.isJoinResult) {
+			joinCallResult(visitor->workItem.callInst, visitor->returnValueSource);
+		} else {
+			currentRoot->callResults[visitor->workItem.callInst] = visitor->returnValueSource;
+		}
+		ContextSummary * context = visitor->context;
+		if (context) {
+			if (context->isVisited) {
+				joinPointerSource(context->returnValueSource, visitor->returnValueSource);
+			} else {
+				context->returnValueSource = visitor->returnValueSource;
+			}
+			context->isVisited = true;
+		}
+		if (visitor->workItem.callInst) {
+			finishedCallCount++;
+			finishedCallVisits += visitCount - visitor->visitsAtStart;
+		}
+		currentRoot->visitorsStack.pop_back();
+		llvm::Function * F = visitor->workItem.function;
+		if ((--activeFunctions[F] == 0) && materializedFunctions.erase(F)) {
+			dematerialize(*visitor);
+		}
 		delete visitor;
 	}
 }
 
-void MemoryLocality::callAdded(WorkQueueItem & item) {
+void MemoryLocality::dematerialize(LocalityFunctionVisitor & visitor) {
+	llvm::Function * F = visitor.workItem.function;
+	if (!F->isDematerializable()) {
+		return;
+	}
+	for (std::vector<LocalityRoot *>::iterator rit = roots.begin(), rie = roots.end();
+			rit != rie; rit++) {
+		for (std::vector<llvm::CallInst *>::iterator it = visitor.issuedCalls.begin(),
+								ie = visitor.issuedCalls.end();
+				it != ie; it++) {
+			(*rit)->callResults.erase(*it);
+		}
+	}
+	dematerialize(F);
+}
+
+// Also drops what was built over the body
+void MemoryLocality::dematerialize(llvm::Function * F) {
+	if (!F->isDematerializable()) {
+		return;
+	}
+	std::map<llvm::Function *, PointerSourceTemplate *>::iterator it =
+			pointerSourceTemplates.find(F);
+	if (it != pointerSourceTemplates.end()) {
+		delete it->second;
+		pointerSourceTemplates.erase(it);
+	}
+	std::map<llvm::Function *, llvm::FunctionValueIndex *>::iterator iit =
+			valueIndices.find(F);
+	if (iit != valueIndices.end()) {
+		delete iit->second;
+		valueIndices.erase(iit);
+	}
+	F->Dematerialize();
+}
+
+PointerSourceTemplate * MemoryLocality::getPointerSourceTemplate(llvm::Function * F) {
+	if (!MemoryLocalityPointerSourceTemplates || F->isDeclaration()) {
+		return 0;
+	}
+	PointerSourceTemplate *& result = pointerSourceTemplates[F];
+	if (!result) {
+		result = new PointerSourceTemplate();
+		result->build(*F);
+	}
+	return result;
+}
+
+llvm::FunctionValueIndex * MemoryLocality::getValueIndex(llvm::Function * F) {
+	if (F->isDeclaration()) {
+		return 0;
+	}
+	llvm::FunctionValueIndex *& result = valueIndices[F];
+	if (!result) {
+		result = new llvm::FunctionValueIndex(*F);
+	}
+	return result;
+}
+
+void MemoryLocality::callAdded(WorkQueueItem & contextItem) {
+	WorkQueueItem item(contextItem);
+	bool isCovered = false;
+	ContextSummary * context = getContext(item, currentRoot, isCovered);
+	if (isCovered) {
+		// Already analysed, in a context at least as general
+		setCallResult(item, context->returnValueSource);
+		return;
+	}
+	LocalityFunctionVisitor * visitor = createVisitor(item, currentRoot);
+	visitor->context = context;
+	visitor->start();
+	if (visitor->isFinished) {
+		// Never became active: Release a body brought in for it alone
+		if (!activeFunctions[item.function] && materializedFunctions.erase(item.function)) {
+			dematerialize(*visitor);
+		}
+		delete visitor;
+	} else {
+		visitor->visitsAtStart = visitCount++;
+		currentRoot->visitorsStack.push_back(visitor);
+		activeFunctions[item.function]++;
+	}
+}
+
+LocalityFunctionVisitor * MemoryLocality::createVisitor(WorkQueueItem & item,
+		LocalityRoot * root) {
+	// Lazily loaded modules: Bring in the body when first reached
+	if (item.function->isMaterializable()) {
+		std::string error;
+		if (item.function->Materialize(&error)) {
+			llvm::errs() << "Failed to materialize " <<
+					item.function->getName() << ": " << error << "\n";
+		} else {
+			materializedFunctions.insert(item.function);
+		}
+	}
 	MemoryDependenceAnalysis * mda = 0;
 	if (!item.function->isDeclaration()) {
 		mda = &getAnalysisID<MemoryDependenceAnalysis>(&llvm::MemoryDependenceAnalysis::ID, *item.function);
 	}
-	LocalityFunctionVisitor * visitor = new LocalityFunctionVisitor(item, mda,
+	return new LocalityFunctionVisitor(item, mda,
 			&getAnalysis<llvm::AliasAnalysis>(),
 			&getAnalysis<llvm::DataLayout>(),
 			&getAnalysis<llvm::AllocIdentify>(),
-			callResults);
-	visitor->start();
-	if (visitor->isFinished) {
-		delete visitor;
+			root->callResults, indirectCallIndex,
+			getPointerSourceTemplate(item.function),
+			getValueIndex(item.function));
+}
+
+unsigned MemoryLocality::getCallSiteCount(llvm::Function * F) {
+	std::map<llvm::Function *, unsigned>::iterator it = callSiteCounts.find(F);
+	if (it != callSiteCounts.end()) {
+		return it->second;
+	}
+	unsigned result = 0;
+	for (llvm::Function::iterator bit = F->begin(), bie = F->end(); bit != bie; bit++) {
+		for (llvm::BasicBlock::iterator iit = bit->begin(), iie = bit->end();
+				iit != iie; iit++) {
+			if (llvm::isa<llvm::CallInst>(iit)) {
+				result++;
+			}
+		}
+	}
+	callSiteCounts[F] = result;
+	return result;
+}
+
+// The remaining call tree is estimated as the call sites not yet reached on
+// the stacks, times the visits a finished call took on average
+void MemoryLocality::reportProgress() {
+	unsigned depth = 0;
+	uint64_t remainingCallSites = 0;
+	for (std::vector<LocalityRoot *>::iterator rit = roots.begin(), rie = roots.end();
+			rit != rie; rit++) {
+		std::vector<LocalityFunctionVisitor *> & stack = (*rit)->visitorsStack;
+		depth += stack.size();
+		for (std::vector<LocalityFunctionVisitor *>::iterator it = stack.begin(),
+										ie = stack.end();
+				it != ie; it++) {
+			unsigned callSites = getCallSiteCount((*it)->workItem.function);
+			if (callSites > (*it)->callSitesPassed) {
+				remainingCallSites += callSites - (*it)->callSitesPassed;
+			}
+		}
+	}
+	uint64_t remainingVisits = remainingCallSites;
+	if (finishedCallCount > 0) {
+		remainingVisits = remainingCallSites * finishedCallVisits / finishedCallCount;
+	}
+	llvm::errs() << "Locality: " << instructionCount << " instructions, " <<
+			visitCount << " functions visited, stack depth " << depth << ", " <<
+			accessCount << " accesses on edges, about " << remainingVisits <<
+			" function visits remaining\n";
+}
+
+// Written to a temporary file first, so that being killed while writing
+// keeps the previous checkpoint. Merged contexts are not saved: They only
+// spare work, and are rebuilt after resuming.
+bool MemoryLocality::writeCheckpoint(const char * path) {
+	std::string temporaryPath = std::string(path) + ".tmp";
+	std::string errorInfo;
+	{
+		llvm::raw_fd_ostream O(temporaryPath.c_str(), errorInfo,
+				llvm::raw_fd_ostream::F_Binary);
+		if (!errorInfo.empty()) {
+			llvm::errs() << "Could not write checkpoint " << temporaryPath <<
+					": " << errorInfo << "\n";
+			return false;
+		}
+		CheckpointWriter writer(O);
+		O << "MLCK";
+		writer.writeWord(CHECKPOINT_VERSION);
+		writer.writeCount(moduleFingerprint);
+		writer.writeCount(instructionCount);
+		writer.writeCount(visitCount);
+		writer.writeCount(accessCount);
+		writer.writeCount(finishedCallCount);
+		writer.writeCount(finishedCallVisits);
+		graph.finalize();
+		globalGraph.finalize();
+		writer.writeGraph(graph);
+		writer.writeGraph(globalGraph);
+		writer.writeWord(roots.size());
+		for (std::vector<LocalityRoot *>::iterator rit = roots.begin(), rie = roots.end();
+				rit != rie; rit++) {
+			LocalityRoot * root = *rit;
+			writer.writeFunction(root->function);
+			root->graph.finalize();
+			writer.writeGraph(root->graph);
+			writer.writeWord(root->callResults.size());
+			for (std::map<llvm::CallInst*, PointerSource>::iterator it = root->callResults.begin(),
+											ie = root->callResults.end();
+					it != ie; it++) {
+				writer.writeInstruction(it->first);
+				writer.writeSource(it->second);
+			}
+			writer.writeWord(root->visitorsStack.size());
+			for (std::vector<LocalityFunctionVisitor *>::iterator it = root->visitorsStack.begin(),
+											ie = root->visitorsStack.end();
+					it != ie; it++) {
+				LocalityFunctionVisitor * visitor = *it;
+				WorkQueueItem & item = visitor->workItem;
+				writer.writeFunction(item.function);
+				writer.writeInstruction(item.callInst);
+				writer.writeWord(item.isJoinResult);
+				writer.writeWord(item.callers.size());
+				for (std::set<llvm::Function *>::iterator cit = item.callers.begin(),
+										cie = item.callers.end();
+						cit != cie; cit++) {
+					writer.writeFunction(*cit);
+				}
+				writer.writeWord(item.callString.size());
+				for (unsigned idx = 0; idx < item.callString.size(); idx++) {
+					writer.writeInstruction(item.callString[idx]);
+				}
+				writer.writeWord(item.argumentSources.size());
+				for (unsigned idx = 0; idx < item.argumentSources.size(); idx++) {
+					writer.writeSource(item.argumentSources[idx]);
+				}
+				writer.writeWord(visitor->position);
+				writer.writeWord(visitor->callSitesPassed);
+				writer.writeCount(visitor->visitsAtStart);
+				writer.writeSource(visitor->returnValueSource);
+				writer.writeWord(visitor->issuedCalls.size());
+				for (unsigned idx = 0; idx < visitor->issuedCalls.size(); idx++) {
+					writer.writeInstruction(visitor->issuedCalls[idx]);
+				}
+			}
+		}
+		O.close();
+		if (O.has_error()) {
+			O.clear_error();
+			llvm::errs() << "Could not write checkpoint " << temporaryPath << "\n";
+			return false;
+		}
+	}
+	if (std::rename(temporaryPath.c_str(), path) != 0) {
+		llvm::errs() << "Could not replace checkpoint " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+static bool readCallInst(CheckpointReader & reader, llvm::CallInst *& callInst) {
+	llvm::Instruction * instruction;
+	if (!reader.readInstruction(instruction)) {
+		return false;
+	}
+	callInst = llvm::dyn_cast_or_null<llvm::CallInst>(instruction);
+	return (callInst || !instruction);
+}
+
+// Nothing is changed unless the whole checkpoint reads
+bool MemoryLocality::readCheckpoint(llvm::Module &M, const char * path) {
+	llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+	if (llvm::error_code error = llvm::MemoryBuffer::getFile(path, buffer)) {
+		llvm::errs() << "Could not read checkpoint " << path << ": " <<
+				error.message() << "\n";
+		return false;
+	}
+	llvm::StringRef data = buffer->getBuffer();
+	if (!data.startswith("MLCK")) {
+		llvm::errs() << "Not a checkpoint: " << path << "\n";
+		return false;
+	}
+	CheckpointReader reader(M, data.substr(4));
+	std::set<llvm::Function *> wasMaterialized(materializedFunctions);
+	unsigned version = 0;
+	uint64_t counts[5];
+	LocalityGraph newGraph;
+	LocalityGraph newGlobalGraph;
+	unsigned rootCount = 0;
+	uint64_t fingerprint = 0;
+	bool isRead = reader.readWord(version) && (version == CHECKPOINT_VERSION) &&
+			reader.readCount(fingerprint);
+	// Instructions are named by position: Another module's would resolve
+	// to the wrong ones
+	if (isRead && (fingerprint != moduleFingerprint)) {
+		llvm::errs() << "Checkpoint " << path << " is of another module, starting over\n";
+		return false;
+	}
+	for (unsigned idx = 0; isRead && (idx < 5); idx++) {
+		isRead = reader.readCount(counts[idx]);
+	}
+	isRead = isRead && reader.readGraph(newGraph) &&
+			reader.readGraph(newGlobalGraph) && reader.readWord(rootCount);
+	std::vector<LocalityRoot *> newRoots;
+	for (unsigned ridx = 0; isRead && (ridx < rootCount); ridx++) {
+		llvm::Function * F;
+		unsigned count = 0;
+		isRead = reader.readFunction(F) && F;
+		if (!isRead) {
+			break;
+		}
+		LocalityRoot * root = new LocalityRoot(F);
+		newRoots.push_back(root);
+		isRead = reader.readGraph(root->graph) && reader.readWord(count);
+		for (unsigned idx = 0; isRead && (idx < count); idx++) {
+			llvm::CallInst * callInst;
+			PointerSource source;
+			isRead = readCallInst(reader, callInst) && reader.readSource(source);
+			root->callResults[callInst] = source;
+		}
+		isRead = isRead && reader.readWord(count);
+		for (unsigned idx = 0; isRead && (idx < count); idx++) {
+			WorkQueueItem item;
+			unsigned isJoinResult = 0;
+			unsigned size = 0;
+			isRead = reader.readFunction(item.function) && item.function &&
+					readCallInst(reader, item.callInst) &&
+					reader.readWord(isJoinResult) && reader.readWord(size);
+			item.isJoinResult = isJoinResult;
+			for (unsigned cidx = 0; isRead && (cidx < size); cidx++) {
+				llvm::Function * caller;
+				isRead = reader.readFunction(caller);
+				item.callers.insert(caller);
+			}
+			isRead = isRead && reader.readWord(size);
+			for (unsigned cidx = 0; isRead && (cidx < size); cidx++) {
+				llvm::CallInst * callInst;
+				isRead = readCallInst(reader, callInst);
+				item.callString.push_back(callInst);
+			}
+			isRead = isRead && reader.readWord(size);
+			for (unsigned aidx = 0; isRead && (aidx < size); aidx++) {
+				PointerSource source;
+				isRead = reader.readSource(source);
+				item.argumentSources.push_back(source);
+			}
+			unsigned position = 0;
+			isRead = isRead && reader.readWord(position);
+			if (!isRead) {
+				break;
+			}
+			LocalityFunctionVisitor * visitor = createVisitor(item, root);
+			// Contexts are not saved: The visitor's is rebuilt empty
+			bool isCovered;
+			visitor->context = getContext(item, root, isCovered);
+			root->visitorsStack.push_back(visitor);
+			isRead = visitor->skip(position) &&
+					reader.readWord(visitor->callSitesPassed) &&
+					reader.readCount(visitor->visitsAtStart) &&
+					reader.readSource(visitor->returnValueSource) &&
+					reader.readWord(size);
+			for (unsigned cidx = 0; isRead && (cidx < size); cidx++) {
+				llvm::CallInst * callInst;
+				isRead = readCallInst(reader, callInst);
+				visitor->issuedCalls.push_back(callInst);
+			}
+		}
+	}
+	isRead = isRead && reader.isAtEnd();
+	if (!isRead) {
+		llvm::errs() << "Could not read checkpoint " << path << ", starting over\n";
+		for (std::vector<LocalityRoot *>::iterator rit = newRoots.begin(), rie = newRoots.end();
+				rit != rie; rit++) {
+			std::vector<LocalityFunctionVisitor *> & stack = (*rit)->visitorsStack;
+			for (std::vector<LocalityFunctionVisitor *>::iterator it = stack.begin(),
+											ie = stack.end();
+					it != ie; it++) {
+				delete *it;
+			}
+			delete *rit;
+		}
+		// Bodies brought in by the reader, or for the visitors read
+		std::set<llvm::Function *> materialized(reader.materialized);
+		for (std::set<llvm::Function *>::iterator it = materializedFunctions.begin(),
+								ie = materializedFunctions.end();
+				it != ie; it++) {
+			if (!wasMaterialized.count(*it)) {
+				materialized.insert(*it);
+			}
+		}
+		for (std::set<llvm::Function *>::iterator it = materialized.begin(),
+								ie = materialized.end();
+				it != ie; it++) {
+			materializedFunctions.erase(*it);
+			dematerialize(*it);
+		}
+		return false;
+	}
+	materializedFunctions.insert(reader.materialized.begin(), reader.materialized.end());
+	instructionCount = counts[0];
+	visitCount = counts[1];
+	accessCount = counts[2];
+	finishedCallCount = counts[3];
+	finishedCallVisits = counts[4];
+	graph = newGraph;
+	globalGraph = newGlobalGraph;
+	roots = newRoots;
+	for (std::vector<LocalityRoot *>::iterator rit = roots.begin(), rie = roots.end();
+			rit != rie; rit++) {
+		std::vector<LocalityFunctionVisitor *> & stack = (*rit)->visitorsStack;
+		for (std::vector<LocalityFunctionVisitor *>::iterator it = stack.begin(),
+										ie = stack.end();
+				it != ie; it++) {
+			activeFunctions[(*it)->workItem.function]++;
+		}
+	}
+	llvm::errs() << "Resumed from " << path << " after " << instructionCount <<
+			" instructions\n";
+	return true;
+}
+
+void MemoryLocality::indirectCallAdded(LocalityFunctionVisitor & visitor) {
+	WorkQueueItem & item = visitor.newWorkItem;
+	// Rebuilt from the candidates' results
+	currentRoot->callResults.erase(item.callInst);
+	for (std::vector<llvm::Function *>::iterator it = visitor.calleeCandidates.begin(),
+							ie = visitor.calleeCandidates.end();
+			it != ie; it++) {
+		WorkQueueItem candidateItem(item);
+		candidateItem.function = *it;
+		candidateItem.isJoinResult = true;
+		if (!candidateItem.callers.insert(*it).second) {
+			// Its result is not known either
+			visitor.addEdge("Unknown locality (INACCURACY, Recursion)");
+			joinCallResult(item.callInst, PointerSource());
+			continue;
+		}
+		callAdded(candidateItem);
+	}
+}
+
+void MemoryLocality::joinCallResult(llvm::CallInst * callInst,
+		const PointerSource & source) {
+	std::map<llvm::CallInst*, PointerSource> & callResults = currentRoot->callResults;
+	std::map<llvm::CallInst*, PointerSource>::iterator it = callResults.find(callInst);
+	if (it == callResults.end()) {
+		callResults[callInst] = source;
+		return;
+	}
+	// Candidates disagree: Unknown
+	joinPointerSource(it->second, source);
+}
+
+void MemoryLocality::setCallResult(const WorkQueueItem & item,
+		const PointerSource & source) {
+	if (!item.callInst) {
+		return;
+	}
+	if (item.isJoinResult) {
+		joinCallResult(item.callInst, source);
 	} else {
-		localityVisitorsStack.push_back(visitor);
+		currentRoot->callResults[item.callInst] = source;
 	}
 }
 
+// Names rather than addresses: Lazily loaded bodies are freed and brought
+// in again at other addresses
+std::string MemoryLocality::getContextKey(const WorkQueueItem & item) {
+	std::string result;
+	llvm::raw_string_ostream O(result);
+	O << item.function->getName();
+	if (MemoryLocalityContextKind == Context_Arguments) {
+		for (std::vector<PointerSource>::const_iterator it = item.argumentSources.begin(),
+								ie = item.argumentSources.end();
+				it != ie; it++) {
+			O << "|" << it->type << ":";
+			if (it->argument) {
+				O << it->argument->getParent()->getName() << "#" <<
+						it->argument->getArgNo();
+			}
+			O << ":" << it->name;
+		}
+	} else {
+		for (std::vector<llvm::CallInst *>::const_iterator it = item.callString.begin(),
+								ie = item.callString.end();
+				it != ie; it++) {
+			llvm::Function * caller = (*it)->getParent()->getParent();
+			O << "|" << caller->getName() << "#" <<
+					getValueIndex(caller)->getIndex(*it);
+		}
+	}
+	return O.str();
+}
+
+// Returns the merged context of item, or 0 if contexts are not merged.
+// Widens the item's arguments to those of the context. isCovered is set if
+// the context was analysed with these arguments already.
+ContextSummary * MemoryLocality::getContext(WorkQueueItem & item,
+		LocalityRoot * root, bool & isCovered) {
+	isCovered = false;
+	if ((MemoryLocalityContextKind == Context_CallString) &&
+			(MemoryLocalityContextDepth < 0)) {
+		return 0;
+	}
+	std::pair<std::map<std::string, ContextSummary>::iterator, bool> inserted =
+			root->contexts.insert(std::make_pair(getContextKey(item), ContextSummary()));
+	ContextSummary & result = inserted.first->second;
+	if (inserted.second) {
+		result.argumentSources = item.argumentSources;
+		return &result;
+	}
+	bool isChanged = false;
+	if (result.argumentSources.size() != item.argumentSources.size()) {
+		// Variadic calls
+		result.argumentSources.resize(std::min(result.argumentSources.size(),
+				item.argumentSources.size()));
+		isChanged = true;
+	}
+	for (unsigned idx = 0; idx < result.argumentSources.size(); idx++) {
+		isChanged |= joinPointerSource(result.argumentSources[idx],
+				item.argumentSources[idx]);
+	}
+	item.argumentSources = result.argumentSources;
+	isCovered = result.isVisited && !isChanged;
+	return &result;
+}
+
 llvm::Function * MemoryLocality::getRoot(llvm::Module &M) const {
 	llvm::Function * result = M.getFunction("main");
 	if (result) {
@@ -525,27 +1338,85 @@ llvm::Function * MemoryLocality::getRoot(llvm::Module &M) const {
 }
 
 void MemoryLocality::addEdge(const std::string & u, const std::string & v) {
-	std::set<std::string> & dests = edges[u];
-	dests.insert(v);
+	// Weighted by the number of accesses
+	graph.addEdge(u, v);
+	currentRoot->graph.addEdge(u, v);
+	accessCount++;
 }
 
 void MemoryLocality::print(llvm::raw_ostream &O, const llvm::Module *M) const {
+	const LocalityGraph * view = &graph;
+	LocalityGraph condensed;
+	LocalityGraph heaviest;
+	if (MemoryLocalityPrintCondensed) {
+		view->condense(condensed);
+		view = &condensed;
+	}
+	if (MemoryLocalityPrintHeaviestEdges > 0) {
+		view->getHeaviest(MemoryLocalityPrintHeaviestEdges, heaviest);
+		view = &heaviest;
+	}
 	O << "digraph Locality {\n";
-	for (llvm::Module::const_iterator it = M->begin(), ie = M->end();
-			it != ie; it++) {
-		O << "\t\"" << it->getName() << "\";\n";
+	if (MemoryLocalityPrintIsolatedFunctions && (view == &graph)) {
+		for (llvm::Module::const_iterator it = M->begin(), ie = M->end();
+				it != ie; it++) {
+			O << "\t\"" << it->getName() << "\";\n";
+		}
 	}
-	for (EdgesType::const_iterator it = edges.begin(), ie = edges.end();
-			it != ie; it++) {
-		for (std::set<std::string>::const_iterator vit = it->second.begin(),
-								vie = it->second.end();
-				vit != vie; vit++) {
-			O << "\t\"" << it->first << "\" -> \"" << *vit << "\";\n";
+	if ((roots.size() <= 1) || MemoryLocalityPrintCondensed) {
+		if (roots.size() > 1) {
+			// Components have no counterpart in the roots' graphs
+			O << "\t// Condensed: Edges are not labelled with roots\n";
+		}
+		view->printDOTEdges(O, MemoryLocalityPrintEdgeWeights);
+		O << "}\n";
+		return;
+	}
+	// Label edges with the roots they were found from
+	for (LocalityGraph::NodeId u = 0; u < view->getNodeCount(); u++) {
+		for (unsigned edge = view->getEdgesBegin(u); edge < view->getEdgesEnd(u); edge++) {
+			const std::string & target = view->getName(view->getTarget(edge));
+			O << "\t\"" << view->getName(u) << "\" -> \"" << target << "\" [";
+			if (MemoryLocalityPrintEdgeWeights) {
+				O << "weight=" << view->getWeight(edge) << ", ";
+			}
+			O << "label=\"";
+			bool isFirst = true;
+			for (std::vector<LocalityRoot *>::const_iterator it = roots.begin(),
+									ie = roots.end();
+					it != ie; it++) {
+				LocalityGraph::NodeId ru, rv;
+				const LocalityGraph & rootGraph = (*it)->graph;
+				if (rootGraph.getNode(view->getName(u), ru) &&
+						rootGraph.getNode(target, rv) && rootGraph.hasEdge(ru, rv)) {
+					O << (isFirst ? "" : ",") << (*it)->function->getName();
+					isFirst = false;
+				}
+			}
+			O << "\"];\n";
 		}
 	}
 	O << "}\n";
 }
 
+MemoryLocality::~MemoryLocality() {
+	delete indirectCallIndex;
+	for (std::vector<LocalityRoot *>::iterator it = roots.begin(), ie = roots.end();
+			it != ie; it++) {
+		delete *it;
+	}
+	for (std::map<llvm::Function *, PointerSourceTemplate *>::iterator it = pointerSourceTemplates.begin(),
+										ie = pointerSourceTemplates.end();
+			it != ie; it++) {
+		delete it->second;
+	}
+	for (std::map<llvm::Function *, llvm::FunctionValueIndex *>::iterator it = valueIndices.begin(),
+										ie = valueIndices.end();
+			it != ie; it++) {
+		delete it->second;
+	}
+}
+
 char MemoryLocality::ID = 0;
 static llvm::RegisterPass<MemoryLocality> _X(
 		"memlocality",
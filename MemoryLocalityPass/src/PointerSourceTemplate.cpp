@@ -0,0 +1,141 @@
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include <PointerSourceTemplate.h>
+
+#define TEMPLATE_ITERATION_WATERMARK 10
+
+namespace MemoryLocality {
+
+static bool isRoot(const llvm::Value * value) {
+	return llvm::isa<llvm::Argument>(value) || llvm::isa<llvm::GlobalValue>(value) ||
+			llvm::isa<llvm::AllocaInst>(value) || llvm::isa<llvm::CallInst>(value) ||
+			llvm::isa<llvm::ConstantPointerNull>(value) ||
+			llvm::isa<llvm::UndefValue>(value);
+}
+
+llvm::Value * PointerSourceTemplate::getRoot(llvm::Value * value) const {
+	if (isRoot(value)) {
+		return value;
+	}
+	if (llvm::isa<llvm::ConstantExpr>(value)) {
+		llvm::Value * object = llvm::GetUnderlyingObject(value);
+		return isRoot(object) ? object : 0;
+	}
+	std::map<const llvm::Value *, llvm::Value *>::const_iterator it =
+			m_roots.find(value);
+	if (it == m_roots.end()) {
+		return 0;
+	}
+	return it->second;
+}
+
+llvm::Value * PointerSourceTemplate::computeLoadRoot(llvm::LoadInst & LI,
+		const StoredRoots & state) const {
+	llvm::Value * pointer = LI.getPointerOperand();
+	llvm::Value * object = llvm::GetUnderlyingObject(pointer);
+	// Anything else may be written through pointers not traced to it.
+	// Left to MemDep, as are loads from inside an alloca.
+	if (!llvm::isa<llvm::AllocaInst>(object) || m_escaped.count(object) ||
+			(pointer->stripPointerCasts() != object)) {
+		return 0;
+	}
+	StoredRoots::RootsType::const_iterator it = state.roots.find(object);
+	if ((it != state.roots.end()) && it->second) {
+		return it->second;
+	}
+	return 0;
+}
+
+llvm::Value * PointerSourceTemplate::computeRoot(llvm::Instruction & I,
+		const StoredRoots & state) const {
+	if (isRoot(&I)) {
+		return &I;
+	}
+	if (llvm::GetElementPtrInst * gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&I)) {
+		return getRoot(gep->getPointerOperand());
+	}
+	if (llvm::isa<llvm::CastInst>(&I)) {
+		return getRoot(I.getOperand(0));
+	}
+	if (llvm::LoadInst * li = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+		return computeLoadRoot(*li, state);
+	}
+	if (llvm::PHINode * phi = llvm::dyn_cast<llvm::PHINode>(&I)) {
+		// First evaluated incoming value, as the MemDep evaluation does
+		for (unsigned idx = 0; idx < phi->getNumIncomingValues(); idx++) {
+			llvm::Value * root = getRoot(phi->getIncomingValue(idx));
+			if (root) {
+				return root;
+			}
+		}
+	}
+	return 0;
+}
+
+void PointerSourceTemplate::transfer(llvm::BasicBlock & BB,
+		const LatticeType & in, LatticeType & out) {
+	out = in;
+	for (llvm::BasicBlock::iterator it = BB.begin(), ie = BB.end(); it != ie; it++) {
+		if (llvm::StoreInst * si = llvm::dyn_cast<llvm::StoreInst>(&*it)) {
+			// Other stores, and stores inside the object, overwrite
+			// whatever pointer was there
+			llvm::Value * pointer = si->getPointerOperand();
+			llvm::Value * object = llvm::GetUnderlyingObject(pointer);
+			bool isWhole = si->getValueOperand()->getType()->isPointerTy() &&
+					(pointer->stripPointerCasts() == object);
+			out.roots[object] = isWhole ? getRoot(si->getValueOperand()) : 0;
+		} else if (llvm::MemIntrinsic * mi = llvm::dyn_cast<llvm::MemIntrinsic>(&*it)) {
+			out.roots[llvm::GetUnderlyingObject(mi->getDest())] = 0;
+		} else if (llvm::isa<llvm::CallInst>(&*it) && !llvm::isa<llvm::IntrinsicInst>(&*it)) {
+			// The callee may store to anything but this function's
+			// uncaptured stack
+			for (StoredRoots::RootsType::iterator rit = out.roots.begin(),
+								rie = out.roots.end();
+					rit != rie; rit++) {
+				if (!llvm::isa<llvm::AllocaInst>(rit->first) || m_escaped.count(rit->first)) {
+					rit->second = 0;
+				}
+			}
+		}
+		if (!it->getType()->isPointerTy() || isRoot(&*it)) {
+			continue;
+		}
+		llvm::Value * root = computeRoot(*it, out);
+		llvm::Value *& entry = m_roots[&*it];
+		if (entry != root) {
+			entry = root;
+			m_isChanged = true;
+		}
+	}
+}
+
+void PointerSourceTemplate::build(llvm::Function & F) {
+	m_roots.clear();
+	m_escaped.clear();
+	for (llvm::Function::iterator bit = F.begin(), bie = F.end();
+			bit != bie; bit++) {
+		for (llvm::BasicBlock::iterator it = bit->begin(), ie = bit->end();
+				it != ie; it++) {
+			if (llvm::isa<llvm::AllocaInst>(&*it) &&
+					llvm::PointerMayBeCaptured(&*it, true, true)) {
+				m_escaped.insert(&*it);
+			}
+		}
+	}
+	// Phis and loads may refer to values defined later. Blocks whose state
+	// did not change are not revisited by the solver, so solve until no
+	// root changes.
+	llvm::LatticeDataflow<PointerSourceTemplate, llvm::ForwardEdges,
+			llvm::ReversePostOrderWorklist> dataflow(*this, TEMPLATE_ITERATION_WATERMARK);
+	m_isChanged = true;
+	for (int iteration = 0; m_isChanged && (iteration < TEMPLATE_ITERATION_WATERMARK);
+			iteration++) {
+		m_isChanged = false;
+		dataflow.solve(F);
+	}
+}
+
+}
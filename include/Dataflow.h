@@ -0,0 +1,416 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+#include <llvm/Support/CFG.h>
+
+namespace llvm {
+	// Dataflow framework shared by MemoryAccessPass and MemoryLocality.
+	// Header only.
+	//
+	// DataflowEngine visits basic blocks until no state changes. The states
+	// are kept by its visitor, which provides:
+	//	void visitFunction(Function &);
+	//	void visit(BasicBlock *);
+	//	// Propagates from's state to to. True if to must be visited (again).
+	//	bool join(const BasicBlock * from, const BasicBlock * to);
+	// Which edges states flow along, and in which order pending blocks are
+	// visited, are policies (Edges and Worklist below).
+	//
+	// LatticeDataflow is a visitor keeping the states itself, for problems
+	// over a lattice described by LatticeTraits.
+	//
+	// In MemoryLocality, only PointerSourceTemplate runs on it. The
+	// per-context locality walk is not a fixpoint over blocks, and does
+	// not.
+
+	// Edges policies. Entries are where iteration starts, targets are where
+	// a block's state flows to.
+	struct ForwardEdges {
+		void getEntries(Function & F, std::vector<BasicBlock *> & entries) const {
+			if (!F.empty()) {
+				entries.push_back(&F.getEntryBlock());
+			}
+		}
+		void getTargets(BasicBlock * BB, std::vector<BasicBlock *> & targets) const {
+			for (succ_iterator it = succ_begin(BB), ie = succ_end(BB); it != ie; it++) {
+				targets.push_back(*it);
+			}
+		}
+	};
+
+	struct BackwardEdges {
+		// Exits: Blocks without successors
+		void getEntries(Function & F, std::vector<BasicBlock *> & entries) const {
+			for (Function::iterator it = F.begin(), ie = F.end(); it != ie; it++) {
+				if (succ_begin(&*it) == succ_end(&*it)) {
+					entries.push_back(&*it);
+				}
+			}
+		}
+		void getTargets(BasicBlock * BB, std::vector<BasicBlock *> & targets) const {
+			for (pred_iterator it = pred_begin(BB), ie = pred_end(BB); it != ie; it++) {
+				targets.push_back(*it);
+			}
+		}
+	};
+
+	// Worklist policies. A block is pending at most once. reset() is called
+	// before each run.
+
+	// Base of the worklists ordered by a per block index: The lowest
+	// pending index is visited first
+	class IndexedWorklist {
+	protected:
+		std::map<const BasicBlock *, unsigned> m_indices;
+		std::set<std::pair<unsigned, BasicBlock *> > m_pending;
+	public:
+		void push(BasicBlock * BB) {
+			m_pending.insert(std::make_pair(m_indices[BB], BB));
+		}
+		BasicBlock * pop() {
+			BasicBlock * result = m_pending.begin()->second;
+			m_pending.erase(m_pending.begin());
+			return result;
+		}
+		bool empty() const { return m_pending.empty(); }
+	};
+
+	// Function layout order
+	class LayoutOrderWorklist : public IndexedWorklist {
+	public:
+		void reset(Function & F) {
+			m_indices.clear();
+			m_pending.clear();
+			unsigned index = 0;
+			for (Function::iterator it = F.begin(), ie = F.end(); it != ie; it++) {
+				m_indices[&*it] = index++;
+			}
+		}
+	};
+
+	// Reverse post order of the CFG: A block comes after its predecessors,
+	// back edges aside. Usually the fewest visits for forward problems.
+	class ReversePostOrderWorklist : public IndexedWorklist {
+	public:
+		void reset(Function & F) {
+			m_indices.clear();
+			m_pending.clear();
+			if (F.empty()) {
+				return;
+			}
+			std::vector<BasicBlock *> postOrder;
+			std::set<BasicBlock *> visited;
+			// Block, and its next successor to follow
+			std::vector<std::pair<BasicBlock *, succ_iterator> > stack;
+			BasicBlock * entry = &F.getEntryBlock();
+			visited.insert(entry);
+			stack.push_back(std::make_pair(entry, succ_begin(entry)));
+			while (!stack.empty()) {
+				BasicBlock * BB = stack.back().first;
+				succ_iterator & it = stack.back().second;
+				if (it != succ_end(BB)) {
+					BasicBlock * successor = *it;
+					it++;
+					if (visited.insert(successor).second) {
+						stack.push_back(std::make_pair(successor, succ_begin(successor)));
+					}
+					continue;
+				}
+				postOrder.push_back(BB);
+				stack.pop_back();
+			}
+			unsigned index = 0;
+			for (std::vector<BasicBlock *>::reverse_iterator it = postOrder.rbegin(),
+									ie = postOrder.rend();
+					it != ie; it++) {
+				m_indices[*it] = index++;
+			}
+			// Unreachable blocks last
+			for (Function::iterator it = F.begin(), ie = F.end(); it != ie; it++) {
+				if (!visited.count(&*it)) {
+					m_indices[&*it] = index++;
+				}
+			}
+		}
+	};
+
+	class FIFOWorklist {
+	protected:
+		std::deque<BasicBlock *> m_queue;
+		std::set<BasicBlock *> m_pending;
+	public:
+		void reset(Function & F) {
+			m_queue.clear();
+			m_pending.clear();
+		}
+		void push(BasicBlock * BB) {
+			if (m_pending.insert(BB).second) {
+				m_queue.push_back(BB);
+			}
+		}
+		BasicBlock * pop() {
+			BasicBlock * result = m_queue.front();
+			m_queue.pop_front();
+			m_pending.erase(result);
+			return result;
+		}
+		bool empty() const { return m_queue.empty(); }
+	};
+
+	// Adapts a worklist to carry, per pending block, what changed in its
+	// state since it was last visited. Deltas pushed while the block is
+	// pending are merged. DeltaType is a set: insert(begin, end), swap.
+	template <class Worklist, class DeltaType>
+	class DeltaWorklist {
+	protected:
+		Worklist m_worklist;
+		std::map<BasicBlock *, DeltaType> m_deltas;
+	public:
+		void reset(Function & F) {
+			m_worklist.reset(F);
+			m_deltas.clear();
+		}
+		void push(BasicBlock * BB, const DeltaType & delta) {
+			m_worklist.push(BB);
+			m_deltas[BB].insert(delta.begin(), delta.end());
+		}
+		BasicBlock * pop(DeltaType & delta) {
+			BasicBlock * result = m_worklist.pop();
+			delta.clear();
+			typename std::map<BasicBlock *, DeltaType>::iterator it = m_deltas.find(result);
+			if (it != m_deltas.end()) {
+				delta.swap(it->second);
+				m_deltas.erase(it);
+			}
+			return result;
+		}
+		bool empty() const { return m_worklist.empty(); }
+	};
+
+	template <class Visitor, class Edges = ForwardEdges, class Worklist = LayoutOrderWorklist>
+	class DataflowEngine {
+	protected:
+		Visitor & m_visitor;
+		Edges m_edges;
+		Worklist m_worklist;
+	public:
+		DataflowEngine(Visitor & visitor, const Edges & edges = Edges()) :
+				m_visitor(visitor), m_edges(edges) {}
+
+		void run(Function & F) {
+			m_visitor.visitFunction(F);
+			if (F.empty()) {
+				return;
+			}
+			std::vector<BasicBlock *> entries;
+			m_edges.getEntries(F, entries);
+			run(F, entries);
+		}
+
+		// From the given entries, without visitFunction
+		void run(Function & F, const std::vector<BasicBlock *> & entries) {
+			m_worklist.reset(F);
+			for (std::vector<BasicBlock *>::const_iterator it = entries.begin(),
+									ie = entries.end();
+					it != ie; it++) {
+				m_worklist.push(*it);
+			}
+			std::vector<BasicBlock *> targets;
+			while (!m_worklist.empty()) {
+				BasicBlock * BB = m_worklist.pop();
+				m_visitor.visit(BB);
+				// const: Visitors may overload join for other pairs
+				const BasicBlock * from = BB;
+				targets.clear();
+				m_edges.getTargets(BB, targets);
+				for (std::vector<BasicBlock *>::iterator it = targets.begin(),
+										ie = targets.end();
+						it != ie; it++) {
+					if (m_visitor.join(from, *it)) {
+						m_worklist.push(*it);
+					}
+				}
+			}
+		}
+	};
+
+	// As DataflowEngine, but states are propagated by what changed in them.
+	// The visitor provides visitFunction, and:
+	//	typedef ... DeltaType;
+	//	// changed is what changed in BB's state since its last visit. The
+	//	// visit adds what it changes.
+	//	void visit(BasicBlock * BB, DeltaType & changed);
+	//	// Propagates from's state to to, given what changed in from since
+	//	// the last propagation. Adds what changed in to to toChanged. True
+	//	// if to must be visited (again).
+	//	bool join(const BasicBlock * from, const BasicBlock * to,
+	//			const DeltaType & changed, DeltaType & toChanged);
+	template <class Visitor, class Edges = ForwardEdges, class Worklist = LayoutOrderWorklist>
+	class DeltaDataflowEngine {
+	public:
+		typedef typename Visitor::DeltaType DeltaType;
+	protected:
+		Visitor & m_visitor;
+		Edges m_edges;
+		DeltaWorklist<Worklist, DeltaType> m_worklist;
+	public:
+		DeltaDataflowEngine(Visitor & visitor, const Edges & edges = Edges()) :
+				m_visitor(visitor), m_edges(edges) {}
+
+		void run(Function & F) {
+			m_visitor.visitFunction(F);
+			if (F.empty()) {
+				return;
+			}
+			std::vector<BasicBlock *> entries;
+			m_edges.getEntries(F, entries);
+			run(F, entries);
+		}
+
+		// From the given entries, without visitFunction
+		void run(Function & F, const std::vector<BasicBlock *> & entries) {
+			m_worklist.reset(F);
+			DeltaType changed;
+			for (std::vector<BasicBlock *>::const_iterator it = entries.begin(),
+									ie = entries.end();
+					it != ie; it++) {
+				m_worklist.push(*it, changed);
+			}
+			DeltaType targetChanged;
+			std::vector<BasicBlock *> targets;
+			while (!m_worklist.empty()) {
+				BasicBlock * BB = m_worklist.pop(changed);
+				m_visitor.visit(BB, changed);
+				const BasicBlock * from = BB;
+				targets.clear();
+				m_edges.getTargets(BB, targets);
+				for (std::vector<BasicBlock *>::iterator it = targets.begin(),
+										ie = targets.end();
+						it != ie; it++) {
+					targetChanged.clear();
+					if (m_visitor.join(from, *it, changed, targetChanged)) {
+						m_worklist.push(*it, targetChanged);
+					}
+				}
+			}
+		}
+	};
+
+	// Specialised for each lattice type L:
+	//	static L bottom();
+	//	// Joins other into result. True if result changed.
+	//	static bool join(L & result, const L & other);
+	//	static bool leq(const L & a, const L & b);
+	//	// As join, but going up in finitely many steps. Used for blocks
+	//	// visited more than the widening threshold.
+	//	static bool widen(L & result, const L & other);
+	//	// Bottom states are not stored, and blocks only reached by bottom
+	//	// states are not visited
+	//	static const bool isSparse;
+	template <class L> struct LatticeTraits;
+
+	// Problem provides:
+	//	typedef ... LatticeType;
+	//	// State at the entries
+	//	LatticeType getBoundary(Function &);
+	//	// out is the state after BB, given in before it
+	//	void transfer(BasicBlock & BB, const LatticeType & in, LatticeType & out);
+	template <class Problem, class Edges = ForwardEdges, class Worklist = LayoutOrderWorklist>
+	class LatticeDataflow {
+	public:
+		typedef typename Problem::LatticeType LatticeType;
+		typedef LatticeTraits<LatticeType> Traits;
+		typedef std::map<const BasicBlock *, LatticeType> StatesType;
+	protected:
+		Problem & m_problem;
+		Edges m_edges;
+		unsigned m_wideningThreshold;
+		StatesType m_in;
+		StatesType m_out;
+		std::map<const BasicBlock *, unsigned> m_visitCounts;
+		std::set<const BasicBlock *> m_entries;
+
+		static const LatticeType * find(const StatesType & states, const BasicBlock * BB) {
+			typename StatesType::const_iterator it = states.find(BB);
+			return (it == states.end()) ? 0 : &it->second;
+		}
+	public:
+		LatticeDataflow(Problem & problem, unsigned wideningThreshold = 10,
+				const Edges & edges = Edges()) :
+				m_problem(problem), m_edges(edges),
+				m_wideningThreshold(wideningThreshold) {}
+
+		void solve(Function & F) {
+			m_in.clear();
+			m_out.clear();
+			m_visitCounts.clear();
+			m_entries.clear();
+			if (F.empty()) {
+				return;
+			}
+			std::vector<BasicBlock *> entries;
+			m_edges.getEntries(F, entries);
+			LatticeType boundary = m_problem.getBoundary(F);
+			for (std::vector<BasicBlock *>::iterator it = entries.begin(),
+									ie = entries.end();
+					it != ie; it++) {
+				m_in[*it] = boundary;
+				m_entries.insert(*it);
+			}
+			DataflowEngine<LatticeDataflow, Edges, Worklist> engine(*this, m_edges);
+			engine.run(F, entries);
+		}
+
+		// 0 for blocks not reached, or bottom in a sparse lattice
+		const LatticeType * getIn(const BasicBlock * BB) const { return find(m_in, BB); }
+		const LatticeType * getOut(const BasicBlock * BB) const { return find(m_out, BB); }
+
+		// DataflowEngine visitor
+		void visitFunction(Function & F) {}
+
+		void visit(BasicBlock * BB) {
+			typename StatesType::iterator it = m_in.find(BB);
+			if (it == m_in.end()) {
+				if (Traits::isSparse && !m_entries.count(BB)) {
+					return;
+				}
+				it = m_in.insert(std::make_pair(BB, Traits::bottom())).first;
+			}
+			m_visitCounts[BB]++;
+			typename StatesType::iterator out = m_out.find(BB);
+			if (out == m_out.end()) {
+				out = m_out.insert(std::make_pair(BB, Traits::bottom())).first;
+			}
+			m_problem.transfer(*BB, it->second, out->second);
+		}
+
+		bool join(const BasicBlock * from, const BasicBlock * to) {
+			const LatticeType * out = find(m_out, from);
+			if (!out) {
+				return false;
+			}
+			typename StatesType::iterator it = m_in.find(to);
+			if (it == m_in.end()) {
+				if (Traits::isSparse && Traits::leq(*out, Traits::bottom())) {
+					return false;
+				}
+				m_in.insert(std::make_pair(to, *out));
+				return true;
+			}
+			std::map<const BasicBlock *, unsigned>::const_iterator count =
+					m_visitCounts.find(to);
+			if ((count != m_visitCounts.end()) && (count->second >= m_wideningThreshold)) {
+				return Traits::widen(it->second, *out);
+			}
+			return Traits::join(it->second, *out);
+		}
+	};
+}
+#endif // DATAFLOW_H
@@ -0,0 +1,174 @@
+#ifndef INDIRECT_CALL_INDEX_H
+#define INDIRECT_CALL_INDEX_H
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+namespace llvm {
+	// Candidate callees of indirect calls: the module's address-taken
+	// functions, grouped by signature. Pointer types are not told apart,
+	// since an override's 'this' differs from the overridden method's.
+	// Optionally, calls through a vtable slot (a load from a constant
+	// offset of a loaded table of function pointers) are narrowed to the
+	// functions found at that slot of some _ZTV* global. This assumes such
+	// calls are virtual calls.
+	// Functions whose address is only taken in bodies that are not
+	// materialized when the index is built are missed.
+	// Closed world: Only this module's functions are candidates, matched
+	// on the type of the called pointer. A function called through a
+	// pointer cast to another function type is not a candidate of that
+	// call, and calls whose type matches no function get no candidates.
+	class IndirectCallIndex {
+	public:
+		// Vararg flag, then return and parameter types. Pointers are 0.
+		typedef std::pair<bool, std::vector<Type *> > SignatureType;
+	protected:
+		std::map<SignatureType, std::vector<Function *> > m_candidates;
+		std::map<unsigned, std::set<Function *> > m_slots;
+		bool m_isNarrowVirtualCalls;
+
+		static Type * getKeyType(Type * type) {
+			return type->isPointerTy() ? 0 : type;
+		}
+
+		static SignatureType getSignature(FunctionType * type) {
+			SignatureType result;
+			result.first = type->isVarArg();
+			result.second.push_back(getKeyType(type->getReturnType()));
+			for (unsigned idx = 0; idx < type->getNumParams(); idx++) {
+				result.second.push_back(getKeyType(type->getParamType(idx)));
+			}
+			return result;
+		}
+
+		// Itanium vtables: each address point follows a run of non-function
+		// entries (offsets, RTTI). Slots count the functions after it.
+		void addTable(Constant * table, unsigned & slot) {
+			if (ConstantArray * array = dyn_cast<ConstantArray>(table)) {
+				for (unsigned idx = 0; idx < array->getNumOperands(); idx++) {
+					addTable(array->getOperand(idx), slot);
+				}
+				return;
+			}
+			if (ConstantStruct * structure = dyn_cast<ConstantStruct>(table)) {
+				for (unsigned idx = 0; idx < structure->getNumOperands(); idx++) {
+					addTable(structure->getOperand(idx), slot);
+				}
+				return;
+			}
+			Function * F = dyn_cast<Function>(table->stripPointerCasts());
+			if (!F) {
+				slot = 0;
+				return;
+			}
+			m_slots[slot++].insert(F);
+		}
+
+		// A load of a pointer to function pointers
+		static bool isTableLoad(const Value * value) {
+			if (!isa<LoadInst>(value)) {
+				return false;
+			}
+			PointerType * table = dyn_cast<PointerType>(value->getType());
+			if (!table) {
+				return false;
+			}
+			PointerType * entry = dyn_cast<PointerType>(table->getElementType());
+			return entry && entry->getElementType()->isFunctionTy();
+		}
+
+		// The vtable slot a call goes through, or -1
+		static int getSlot(const CallInst & ci) {
+			const LoadInst * load = dyn_cast<LoadInst>(
+					ci.getCalledValue()->stripPointerCasts());
+			if (!load) {
+				return -1;
+			}
+			const Value * pointer = load->getPointerOperand()->stripPointerCasts();
+			if (isTableLoad(pointer)) {
+				return 0;
+			}
+			const GetElementPtrInst * gep = dyn_cast<GetElementPtrInst>(pointer);
+			if (!gep || (gep->getNumIndices() != 1) ||
+					!isTableLoad(gep->getPointerOperand())) {
+				return -1;
+			}
+			const ConstantInt * index = dyn_cast<ConstantInt>(gep->getOperand(1));
+			if (!index || index->isNegative()) {
+				return -1;
+			}
+			return index->getZExtValue();
+		}
+
+	public:
+		IndirectCallIndex() : m_isNarrowVirtualCalls(false) {}
+
+		void build(Module & M, bool isNarrowVirtualCalls = false) {
+			m_candidates.clear();
+			m_slots.clear();
+			m_isNarrowVirtualCalls = isNarrowVirtualCalls;
+			for (Module::iterator it = M.begin(), ie = M.end(); it != ie; it++) {
+				Function * F = &*it;
+				if (F->isIntrinsic() || !F->hasAddressTaken()) {
+					continue;
+				}
+				m_candidates[getSignature(F->getFunctionType())].push_back(F);
+			}
+			for (Module::global_iterator it = M.global_begin(), ie = M.global_end();
+					(it != ie) && isNarrowVirtualCalls; it++) {
+				if (!it->hasInitializer() || !it->getName().startswith("_ZTV")) {
+					continue;
+				}
+				unsigned slot = 0;
+				addTable(it->getInitializer(), slot);
+			}
+		}
+
+		// Returns false if the call's callees are unknown, or more than
+		// limit
+		bool getCallees(const CallInst & ci, std::vector<Function *> & callees,
+				unsigned limit) const {
+			callees.clear();
+			PointerType * pointerType = cast<PointerType>(
+					ci.getCalledValue()->getType());
+			FunctionType * type = cast<FunctionType>(pointerType->getElementType());
+			std::map<SignatureType, std::vector<Function *> >::const_iterator it =
+					m_candidates.find(getSignature(type));
+			if (it == m_candidates.end()) {
+				return false;
+			}
+			const std::set<Function *> * slotFunctions = 0;
+			int slot = m_isNarrowVirtualCalls ? getSlot(ci) : -1;
+			if (slot >= 0) {
+				std::map<unsigned, std::set<Function *> >::const_iterator sit =
+						m_slots.find(slot);
+				if (sit != m_slots.end()) {
+					slotFunctions = &sit->second;
+				}
+			}
+			for (std::vector<Function *>::const_iterator fit = it->second.begin(),
+								fie = it->second.end();
+					fit != fie; fit++) {
+				if (slotFunctions && !slotFunctions->count(*fit)) {
+					continue;
+				}
+				callees.push_back(*fit);
+				if (callees.size() > limit) {
+					return false;
+				}
+			}
+			return !callees.empty();
+		}
+	};
+}
+
+#endif // INDIRECT_CALL_INDEX_H
@@ -0,0 +1,230 @@
+#ifndef VALUE_VISITOR_H
+#define VALUE_VISITOR_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/InstVisitor.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace llvm {
+	// Visitor over any value, shared by MemoryAccessPass and MemoryLocality.
+	// Instructions go to InstVisitor. Other values are dispatched on their
+	// value ID to visitArgument, visitGlobalValue, visitConstantInt,
+	// visitConstantFP, visitConstantPointerNull, visitUndefValue,
+	// visitConstantExpr, visitConstant or visitValue. Kinds of constants
+	// default to visitConstant.
+	//
+	// visit() looks the value up in the Cache first, and on a hit returns
+	// visitCached(value, cached). Results are only cached when T inserts
+	// them, since only T knows which are context free.
+	// Cache policies provide:
+	//	typedef ... CachedType;
+	//	// 0 if not cached
+	//	CachedType * find(const Value *);
+	//	// Does not replace
+	//	void insert(const Value *, const CachedType &);
+	//	void clear();
+
+	class NoValueCache {
+	public:
+		typedef char CachedType;
+		CachedType * find(const Value * value) { return 0; }
+		void insert(const Value * value, const CachedType & result) {}
+		void clear() {}
+	};
+
+	// Any map from const Value * with find, insert and clear. By default
+	// hashed. Owns its map, or uses one given.
+	template <typename MapType>
+	class MapValueCache {
+	public:
+		typedef typename MapType::mapped_type CachedType;
+	protected:
+		MapType m_owned;
+		MapType * m_map;
+
+		MapValueCache & operator=(const MapValueCache & other);
+	public:
+		MapValueCache() : m_map(&m_owned) {}
+		MapValueCache(MapType & map) : m_map(&map) {}
+		MapValueCache(const MapValueCache & other) : m_owned(other.m_owned),
+				m_map((other.m_map == &other.m_owned) ? &m_owned : other.m_map) {}
+
+		CachedType * find(const Value * value) {
+			typename MapType::iterator it = m_map->find(value);
+			return (it == m_map->end()) ? 0 : &it->second;
+		}
+		void insert(const Value * value, const CachedType & result) {
+			m_map->insert(std::make_pair(value, result));
+		}
+		void clear() { m_map->clear(); }
+		MapType & getMap() { return *m_map; }
+	};
+
+	// Numbers a function's arguments, then its instructions, from 0.
+	// Values carry no spare field to keep the number in, so finding it is
+	// one hashed lookup, shared by all caches over the function.
+	class FunctionValueIndex {
+	protected:
+		DenseMap<const Value *, unsigned> m_indices;
+	public:
+		static const unsigned None = ~0u;
+
+		FunctionValueIndex(const Function & F) {
+			unsigned index = 0;
+			for (Function::const_arg_iterator it = F.arg_begin(), ie = F.arg_end();
+					it != ie; it++) {
+				m_indices[&*it] = index++;
+			}
+			for (Function::const_iterator bit = F.begin(), bie = F.end(); bit != bie; bit++) {
+				for (BasicBlock::const_iterator it = bit->begin(), ie = bit->end();
+						it != ie; it++) {
+					m_indices[&*it] = index++;
+				}
+			}
+		}
+		unsigned size() const { return m_indices.size(); }
+		unsigned getIndex(const Value * value) const {
+			DenseMap<const Value *, unsigned>::const_iterator it = m_indices.find(value);
+			return (it == m_indices.end()) ? None : it->second;
+		}
+	};
+
+	// Vector indexed by FunctionValueIndex. Values outside the function
+	// (globals, constants), or all values without an index, are hashed.
+	template <typename ValueType>
+	class DenseValueCache {
+	public:
+		typedef ValueType CachedType;
+	protected:
+		const FunctionValueIndex * m_index;
+		std::vector<ValueType> m_values;
+		std::vector<bool> m_isCached;
+		DenseMap<const Value *, ValueType> m_others;
+
+		unsigned getIndex(const Value * value) const {
+			return m_index ? m_index->getIndex(value) : FunctionValueIndex::None;
+		}
+	public:
+		DenseValueCache(const FunctionValueIndex * index = 0) : m_index(index) {}
+
+		CachedType * find(const Value * value) {
+			unsigned index = getIndex(value);
+			if (index == FunctionValueIndex::None) {
+				typename DenseMap<const Value *, ValueType>::iterator it = m_others.find(value);
+				return (it == m_others.end()) ? 0 : &it->second;
+			}
+			if ((index >= m_isCached.size()) || !m_isCached[index]) {
+				return 0;
+			}
+			return &m_values[index];
+		}
+		void insert(const Value * value, const CachedType & result) {
+			unsigned index = getIndex(value);
+			if (index == FunctionValueIndex::None) {
+				m_others.insert(std::make_pair(value, result));
+				return;
+			}
+			if (m_values.empty()) {
+				m_values.resize(m_index->size());
+				m_isCached.resize(m_index->size(), false);
+			}
+			if (!m_isCached[index]) {
+				m_values[index] = result;
+				m_isCached[index] = true;
+			}
+		}
+		void clear() {
+			m_values.clear();
+			m_isCached.clear();
+			m_others.clear();
+		}
+	};
+
+	template <typename T, typename RetType=void, typename Cache=NoValueCache>
+	class ValueVisitor : public InstVisitor<T, RetType> {
+	protected:
+		Cache m_cache;
+
+		RetType dispatch(Value & value) {
+			T * visitor = static_cast<T*>(this);
+			unsigned id = value.getValueID();
+			if (id >= Value::InstructionVal) {
+				return InstVisitor<T, RetType>::visit(cast<Instruction>(value));
+			}
+			switch (id) {
+			case Value::ArgumentVal:
+				return visitor->visitArgument(cast<Argument>(value));
+			case Value::FunctionVal:
+			case Value::GlobalVariableVal:
+			case Value::GlobalAliasVal:
+				return visitor->visitGlobalValue(cast<GlobalValue>(value));
+			case Value::ConstantIntVal:
+				return visitor->visitConstantInt(cast<ConstantInt>(value));
+			case Value::ConstantFPVal:
+				return visitor->visitConstantFP(cast<ConstantFP>(value));
+			case Value::ConstantPointerNullVal:
+				return visitor->visitConstantPointerNull(cast<ConstantPointerNull>(value));
+			case Value::UndefValueVal:
+				return visitor->visitUndefValue(cast<UndefValue>(value));
+			case Value::ConstantExprVal:
+				return visitor->visitConstantExpr(cast<ConstantExpr>(value));
+			default:
+				if (isa<Constant>(value)) {
+					return visitor->visitConstant(cast<Constant>(value));
+				}
+				return visitor->visitValue(value);
+			}
+		}
+	public:
+		ValueVisitor() : InstVisitor<T, RetType>() {}
+		ValueVisitor(const Cache & cache) : InstVisitor<T, RetType>(), m_cache(cache) {}
+
+		RetType visitArgument(Argument & argument) { return RetType(); }
+		RetType visitValue(Value & value) { return RetType(); }
+		RetType visitConstant(Constant & constant) { return RetType(); }
+		RetType visitGlobalValue(GlobalValue & globalValue) {
+			return static_cast<T*>(this)->visitConstant(globalValue);
+		}
+		RetType visitConstantInt(ConstantInt & ci) {
+			return static_cast<T*>(this)->visitConstant(ci);
+		}
+		RetType visitConstantFP(ConstantFP & cfp) {
+			return static_cast<T*>(this)->visitConstant(cfp);
+		}
+		RetType visitConstantPointerNull(ConstantPointerNull & constant) {
+			return static_cast<T*>(this)->visitConstant(constant);
+		}
+		RetType visitUndefValue(UndefValue & undefValue) {
+			return static_cast<T*>(this)->visitConstant(undefValue);
+		}
+		RetType visitConstantExpr(ConstantExpr & constantExpr) {
+			return static_cast<T*>(this)->visitConstant(constantExpr);
+		}
+		RetType visitCached(Value & value, const typename Cache::CachedType & cached) {
+			return RetType(cached);
+		}
+
+		RetType visit(Value * value) { return visit(*value); }
+		RetType visit(Value & value) {
+			typename Cache::CachedType * cached = m_cache.find(&value);
+			if (cached) {
+				return static_cast<T*>(this)->visitCached(value, *cached);
+			}
+			return dispatch(value);
+		}
+		RetType visit(Constant * constant) { return visit(*constant); }
+		RetType visit(Constant & constant) { return visit(static_cast<Value &>(constant)); }
+		RetType visit(ConstantExpr * constantExpr) { return visit(*constantExpr); }
+		RetType visit(ConstantExpr & constantExpr) {
+			return visit(static_cast<Value &>(constantExpr));
+		}
+	};
+}
+#endif // VALUE_VISITOR_H